@@ -0,0 +1,594 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "DebugDraw.h"
+#include "LinearOctree.h"
+#include "OcclusionCuller.h"
+#include "Octree.h"
+#include "OctreeLod.h"
+#include "OctreeReplica.h"
+
+namespace
+{
+	constexpr float world_half_size = 1024.0f;
+	constexpr int tree_depth = 8;
+
+	struct Obj
+	{
+		AABB	aabb;
+		const AABB& GetAABB() const { return aabb; }
+	};
+
+	typedef Octree<Obj, tree_depth> Tree;
+	typedef LinearOctree<Obj, tree_depth> LinearTree;
+
+	enum Workload
+	{
+		Uniform,
+		Clustered,
+		Mixed,
+	};
+
+	const char* workload_names[] = { "uniform", "clustered", "mixed" };
+
+	AABB make_box(const vec3& c, float halfSize)
+	{
+		vec3 h{ halfSize, halfSize, halfSize };
+		vec3 lo = c - h, hi = c + h;
+		const float limit = world_half_size;
+		lo = vec3{ std::max(lo.x, -limit), std::max(lo.y, -limit), std::max(lo.z, -limit) };
+		hi = vec3{ std::min(hi.x, limit), std::min(hi.y, limit), std::min(hi.z, limit) };
+		return AABB(lo, hi);
+	}
+
+	// uniform: small boxes spread over the world
+	// clustered: small boxes around 32 gaussian hot spots
+	// mixed: mostly tiny boxes with 5% large ones that get stuck high in the tree
+	std::vector<Obj> make_objects(Workload workload, size_t count, unsigned seed)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> pos(-world_half_size, world_half_size);
+		std::uniform_real_distribution<float> size(0.25f, 1.0f);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		std::normal_distribution<float> spread(0.0f, 16.0f);
+
+		std::vector<vec3> clusters(32);
+		for (auto& c : clusters)
+			c = vec3{ pos(rng) * 0.9f, pos(rng) * 0.9f, pos(rng) * 0.9f };
+
+		std::vector<Obj> objects(count);
+		for (auto& o : objects)
+		{
+			switch (workload)
+			{
+			case Uniform:
+				o.aabb = make_box(vec3{ pos(rng), pos(rng), pos(rng) }, size(rng));
+				break;
+			case Clustered:
+			{
+				const vec3& c = clusters[rng() % clusters.size()];
+				o.aabb = make_box(c + vec3{ spread(rng), spread(rng), spread(rng) }, size(rng));
+				break;
+			}
+			case Mixed:
+				o.aabb = make_box(vec3{ pos(rng), pos(rng), pos(rng) }, unit(rng) < 0.05f ? 8.0f + unit(rng) * 96.0f : size(rng) * 0.5f);
+				break;
+			}
+		}
+		return objects;
+	}
+
+	std::vector<AABB> make_queries(size_t count, float halfSize, unsigned seed)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> pos(-world_half_size, world_half_size);
+
+		std::vector<AABB> queries(count);
+		for (auto& q : queries)
+			q = make_box(vec3{ pos(rng), pos(rng), pos(rng) }, halfSize);
+		return queries;
+	}
+
+	// a built tree for a workload and size, shared by the read only benchmarks
+	struct Scene
+	{
+		std::vector<Obj>			objects;
+		std::unique_ptr<Tree>		tree;
+		std::unique_ptr<LinearTree>	linear;		// built on first use by the linear benchmarks
+	};
+
+	// Keeps only the scene asked for last, so one large scene at most is resident and the
+	// memory figures of later benchmarks are not inflated by earlier ones.
+	Scene& get_scene(Workload workload, size_t count)
+	{
+		static std::unique_ptr<Scene> scene;
+		static std::pair<int, size_t> key;
+
+		if (!scene || key != std::make_pair(static_cast<int>(workload), count))
+		{
+			scene.reset();
+			scene.reset(new Scene());
+			key = std::make_pair(static_cast<int>(workload), count);
+
+			scene->objects = make_objects(workload, count, 1);
+			scene->tree.reset(new Tree(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size));
+			for (auto& o : scene->objects)
+				scene->tree->Insert(&o);
+		}
+		return *scene;
+	}
+
+	LinearTree& get_linear_tree(Workload workload, size_t count)
+	{
+		Scene& scene = get_scene(workload, count);
+		if (!scene.linear)
+		{
+			scene.linear.reset(new LinearTree(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size));
+			for (auto& o : scene.objects)
+				scene.linear->Insert(&o);
+			scene.linear->Compact();
+		}
+		return *scene.linear;
+	}
+
+	void set_percentiles(benchmark::State& state, std::vector<double>& samples)
+	{
+		if (samples.empty())
+			return;
+
+		std::sort(samples.begin(), samples.end());
+		auto at = [&samples](double p) { return samples[static_cast<size_t>(p * (samples.size() - 1))]; };
+
+		state.counters["p50_ns"] = at(0.50);
+		state.counters["p90_ns"] = at(0.90);
+		state.counters["p99_ns"] = at(0.99);
+		state.counters["max_ns"] = samples.back();
+	}
+
+	void BM_Insert(benchmark::State& state)
+	{
+		const Workload workload = static_cast<Workload>(state.range(0));
+		const size_t count = static_cast<size_t>(state.range(1));
+		std::vector<Obj> objects = make_objects(workload, count, 1);
+
+		for (auto _ : state)
+		{
+			Tree tree(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size);
+			for (auto& o : objects)
+				tree.Insert(&o);
+			benchmark::DoNotOptimize(tree.GetRoot());
+		}
+
+		state.SetItemsProcessed(state.iterations() * count);
+		state.SetLabel(workload_names[workload]);
+	}
+
+	// per frame rebuild: Clear() keeps the storage, so only the first frame allocates
+	void BM_ClearAndInsert(benchmark::State& state)
+	{
+		const Workload workload = static_cast<Workload>(state.range(0));
+		const size_t count = static_cast<size_t>(state.range(1));
+		std::vector<Obj> objects = make_objects(workload, count, 1);
+
+		Tree tree(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size);
+		for (auto _ : state)
+		{
+			tree.Clear();
+			for (auto& o : objects)
+				tree.Insert(&o);
+			benchmark::DoNotOptimize(tree.GetRoot());
+		}
+
+		state.SetItemsProcessed(state.iterations() * count);
+		state.SetLabel(workload_names[workload]);
+	}
+
+	void BM_Query(benchmark::State& state)
+	{
+		const Workload workload = static_cast<Workload>(state.range(0));
+		const size_t count = static_cast<size_t>(state.range(1));
+		const float halfSize = static_cast<float>(state.range(2));
+
+		Scene& scene = get_scene(workload, count);
+		std::vector<AABB> queries = make_queries(4096, halfSize, 2);
+
+		std::vector<double> samples;
+		samples.reserve(1 << 16);
+
+		size_t next = 0, hits = 0;
+		for (auto _ : state)
+		{
+			const AABB& q = queries[next++ % queries.size()];
+
+			auto start = std::chrono::steady_clock::now();
+			scene.tree->Query(q, [&hits](Obj*) { hits++; });
+			auto stop = std::chrono::steady_clock::now();
+
+			if (samples.size() < samples.capacity())
+				samples.push_back(std::chrono::duration<double, std::nano>(stop - start).count());
+		}
+
+		set_percentiles(state, samples);
+		state.counters["hits_per_query"] = static_cast<double>(hits) / static_cast<double>(std::max<benchmark::IterationCount>(state.iterations(), 1));
+		state.SetLabel(workload_names[workload]);
+	}
+
+	// as BM_Query over the Morton ordered proxies of a LinearOctree
+	void BM_LinearQuery(benchmark::State& state)
+	{
+		const Workload workload = static_cast<Workload>(state.range(0));
+		const size_t count = static_cast<size_t>(state.range(1));
+		const float halfSize = static_cast<float>(state.range(2));
+
+		LinearTree& tree = get_linear_tree(workload, count);
+		std::vector<AABB> queries = make_queries(4096, halfSize, 2);
+
+		size_t next = 0, hits = 0;
+		for (auto _ : state)
+			tree.Query(queries[next++ % queries.size()], [&hits](Obj*) { hits++; });
+
+		state.counters["hits_per_query"] = static_cast<double>(hits) / static_cast<double>(std::max<benchmark::IterationCount>(state.iterations(), 1));
+		state.SetLabel(workload_names[workload]);
+	}
+
+	// one large region query collecting its hits, serially for workers 0, else with
+	// Octree::QueryParallel on a pool of that many workers
+	void BM_ParallelQuery(benchmark::State& state)
+	{
+		const Workload workload = static_cast<Workload>(state.range(0));
+		const size_t count = static_cast<size_t>(state.range(1));
+		const size_t workers = static_cast<size_t>(state.range(2));
+
+		Scene& scene = get_scene(workload, count);
+		const AABB region = make_box(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size * 0.5f);
+
+		std::unique_ptr<OctreeWorkerPool> pool;
+		if (0 != workers)
+			pool.reset(new OctreeWorkerPool(workers));
+
+		std::vector<Obj*> hits;
+		for (auto _ : state)
+		{
+			hits.clear();
+			if (nullptr != pool)
+				scene.tree->QueryParallel(region, hits, *pool);
+			else
+				scene.tree->Query(region, [&hits](Obj* o) { hits.push_back(o); });
+		}
+
+		state.counters["hits_per_query"] = static_cast<double>(hits.size());
+		state.SetLabel(workload_names[workload]);
+	}
+
+	// Fast moving boxes: mode 0 queries the union of the start and end boxes, mode 1 sweeps
+	// and visits every candidate, mode 2 sweeps and stops at the first one
+	void BM_SweptQuery(benchmark::State& state)
+	{
+		const Workload workload = static_cast<Workload>(state.range(0));
+		const size_t count = static_cast<size_t>(state.range(1));
+		const int mode = static_cast<int>(state.range(2));
+
+		Scene& scene = get_scene(workload, count);
+		std::vector<AABB> boxes = make_queries(4096, 2.0f, 5);
+
+		std::mt19937 rng(6);
+		std::uniform_real_distribution<float> step(-256.0f, 256.0f);
+		std::vector<vec3> deltas(boxes.size());
+		for (auto& d : deltas)
+			d = vec3{ step(rng), step(rng), step(rng) };
+
+		size_t next = 0, candidates = 0;
+		for (auto _ : state)
+		{
+			const size_t i = next++ % boxes.size();
+			const AABB& box = boxes[i];
+
+			if (0 == mode)
+				scene.tree->Query(box.Union(AABB(box.min + deltas[i], box.max + deltas[i])), [&candidates](Obj*) { candidates++; });
+			else
+				scene.tree->QuerySwept(box, deltas[i], [&candidates, mode](Obj*, float) { candidates++; return 2 == mode; });
+		}
+
+		state.counters["candidates_per_query"] = static_cast<double>(candidates) / static_cast<double>(std::max<benchmark::IterationCount>(state.iterations(), 1));
+		state.SetLabel(workload_names[workload]);
+	}
+
+	// screen space cut for a camera inside the world, without and with a node budget
+	void BM_SelectCut(benchmark::State& state)
+	{
+		const Workload workload = static_cast<Workload>(state.range(0));
+		const size_t count = static_cast<size_t>(state.range(1));
+		const size_t budget = static_cast<size_t>(state.range(2));
+
+		Scene& scene = get_scene(workload, count);
+		OctreeScreenSpaceError metric(vec3{ 100.0f, 50.0f, -300.0f }, 3.1415926f * 0.5f, 1080.0f);
+
+		std::vector<const Tree::Node*> cut;
+		for (auto _ : state)
+		{
+			cut.clear();
+			scene.tree->SelectCut(metric, 16.0f, cut, budget);
+		}
+
+		state.counters["cut_nodes"] = static_cast<double>(cut.size());
+		state.SetLabel(workload_names[workload]);
+	}
+
+	// Headless occlusion pass over the scene from one side of the world at 256x128: mode 0
+	// culls against the view only, mode 1 adds a row of walls as occluders, mode 2 also
+	// draws every visible object as an occluder for the ones behind it
+	void BM_OcclusionCull(benchmark::State& state)
+	{
+		const Workload workload = static_cast<Workload>(state.range(0));
+		const size_t count = static_cast<size_t>(state.range(1));
+		const int mode = static_cast<int>(state.range(2));
+
+		Scene& scene = get_scene(workload, count);
+
+		OcclusionCuller culler(256, 128);
+		culler.SetCamera(vec3{ 0.0f, 0.0f, -world_half_size - 100.0f }, vec3{ 0.0f, 0.0f, 1.0f }, 3.1415926f * 0.5f, 1.0f, 4 * world_half_size);
+
+		size_t visible = 0;
+		for (auto _ : state)
+		{
+			culler.Clear();
+			if (0 != mode)
+			{
+				for (int i = -2; i <= 2; i++)
+				{
+					const float x = static_cast<float>(i) * world_half_size * 0.4f;
+					culler.AddOccluder(AABB(vec3{ x - 150.0f, -world_half_size, -200.0f }, vec3{ x + 150.0f, world_half_size, -180.0f }));
+				}
+			}
+
+			visible = 0;
+			culler.QueryVisible(*scene.tree, [&visible, mode](Obj*) { visible++; return 2 == mode; });
+		}
+
+		state.counters["visible_objects"] = static_cast<double>(visible);
+		state.SetLabel(workload_names[workload]);
+	}
+
+	// moves changes objects per iteration in a tree keeping history, then exports and
+	// serialises the delta since the previous one; full_bytes is a reset snapshot for scale
+	void BM_DeltaExport(benchmark::State& state)
+	{
+		const Workload workload = static_cast<Workload>(state.range(0));
+		const size_t count = static_cast<size_t>(state.range(1));
+		const size_t changes = static_cast<size_t>(state.range(2));
+
+		OctreeConfig config;
+		config.history = true;
+
+		std::vector<Obj> objects = make_objects(workload, count, 1);
+		Tree tree(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size, config);
+		for (auto& o : objects)
+			tree.Insert(&o);
+
+		std::mt19937 rng(4);
+		std::uniform_real_distribution<float> step(-2.0f, 2.0f);
+
+		OctreeDelta delta;
+		std::vector<uint8_t> message;
+		uint64_t synced = tree.GetVersion();
+		size_t bytes = 0;
+
+		for (auto _ : state)
+		{
+			state.PauseTiming();
+			for (size_t i = 0; i < changes; i++)
+			{
+				Obj& o = objects[rng() % objects.size()];
+				tree.Remove(&o);
+				vec3 c = (o.aabb.min + o.aabb.max) * 0.5f + vec3{ step(rng), step(rng), step(rng) };
+				vec3 h = (o.aabb.max - o.aabb.min) * 0.5f;
+				o.aabb = make_box(c, std::max(h.x, std::max(h.y, h.z)));
+				tree.Insert(&o);
+			}
+			state.ResumeTiming();
+
+			tree.DiffSince(synced, delta);
+			message.clear();
+			OctreeWriteDelta(delta, message);
+			synced = delta.version;
+			tree.TrimHistory(synced);
+			bytes += message.size();
+		}
+
+		tree.DiffSince(0, delta);
+		delta.reset = true;
+		message.clear();
+		OctreeWriteDelta(delta, message);
+
+		state.counters["bytes_per_delta"] = static_cast<double>(bytes) / static_cast<double>(std::max<benchmark::IterationCount>(state.iterations(), 1));
+		state.counters["full_bytes"] = static_cast<double>(message.size());
+		state.SetLabel(workload_names[workload]);
+	}
+
+	// remove, move by a small step and reinsert one object per iteration
+	void BM_Update(benchmark::State& state)
+	{
+		const Workload workload = static_cast<Workload>(state.range(0));
+		const size_t count = static_cast<size_t>(state.range(1));
+
+		std::vector<Obj> objects = make_objects(workload, count, 1);
+		Tree tree(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size);
+		for (auto& o : objects)
+			tree.Insert(&o);
+
+		std::mt19937 rng(3);
+		std::uniform_real_distribution<float> step(-2.0f, 2.0f);
+
+		for (auto _ : state)
+		{
+			Obj& o = objects[rng() % objects.size()];
+			tree.Remove(&o);
+
+			vec3 d{ step(rng), step(rng), step(rng) };
+			vec3 c = (o.aabb.min + o.aabb.max) * 0.5f + d;
+			vec3 h = (o.aabb.max - o.aabb.min) * 0.5f;
+			o.aabb = make_box(c, std::max(h.x, std::max(h.y, h.z)));
+
+			tree.Insert(&o);
+		}
+
+		state.SetItemsProcessed(state.iterations());
+		state.SetLabel(workload_names[workload]);
+	}
+
+	// full tree pass over every object, also reports the memory the tree itself uses
+	void BM_Traverse(benchmark::State& state)
+	{
+		const Workload workload = static_cast<Workload>(state.range(0));
+		const size_t count = static_cast<size_t>(state.range(1));
+
+		Scene& scene = get_scene(workload, count);
+
+		for (auto _ : state)
+		{
+			float sum = 0.0f;
+			for (Obj* o : *scene.tree)
+				sum += o->aabb.min.x;
+			benchmark::DoNotOptimize(sum);
+		}
+
+		size_t nodes = 0, interior = 0, entries = 0;
+		for (auto node : scene.tree->Nodes())
+		{
+			nodes++;
+			interior += node->IsLeaf() ? 0 : 1;
+			for (auto p = node->objects; nullptr != p; p = p->next)
+				entries++;
+		}
+
+		size_t bytes = nodes * sizeof(Tree::Node) + interior * 8 * sizeof(Tree::Node*) + entries * sizeof(OctreeData<Obj>);
+
+		state.counters["nodes"] = static_cast<double>(nodes);
+		state.counters["bytes_per_object"] = static_cast<double>(bytes) / static_cast<double>(count);
+		state.SetItemsProcessed(state.iterations() * count);
+		state.SetLabel(workload_names[workload]);
+	}
+
+	// what the demo does per frame: one box per node and per object into a debug draw batch
+	void BM_DebugDraw(benchmark::State& state)
+	{
+		const Workload workload = static_cast<Workload>(state.range(0));
+		const size_t count = static_cast<size_t>(state.range(1));
+		const bool instanced = 0 != state.range(2);
+
+		Scene& scene = get_scene(workload, count);
+		DebugDrawList list(instanced);
+
+		size_t boxes = 0, bytes = 0;
+		for (auto _ : state)
+		{
+			list.Clear();
+			for (auto node : scene.tree->Nodes())
+				list.AddBox(AABB(node->GetBound()), vec3{ 0.0f, 1.0f, 0.0f });
+			for (Obj* o : *scene.tree)
+				list.AddBox(o->aabb, vec3{ 1.0f, 0.0f, 0.0f });
+
+			boxes = instanced ? list.GetInstances().size() : list.GetVertexCount() / DebugDrawList::unit_box_vertex_count;
+			bytes = list.GetByteSize();
+			benchmark::DoNotOptimize(list.GetByteSize());
+		}
+
+		state.counters["bytes_per_box"] = static_cast<double>(bytes) / static_cast<double>(std::max<size_t>(boxes, 1));
+		state.counters["32bit_indices"] = list.Uses32BitIndices() ? 1.0 : 0.0;
+		state.SetItemsProcessed(state.iterations() * boxes);
+		state.SetLabel(workload_names[workload]);
+	}
+
+	void BM_LinearTraverse(benchmark::State& state)
+	{
+		const Workload workload = static_cast<Workload>(state.range(0));
+		const size_t count = static_cast<size_t>(state.range(1));
+
+		LinearTree& tree = get_linear_tree(workload, count);
+
+		for (auto _ : state)
+		{
+			float sum = 0.0f;
+			tree.ForEach([&sum](Obj* o) { sum += o->aabb.min.x; });
+			benchmark::DoNotOptimize(sum);
+		}
+
+		state.counters["bytes_per_object"] = static_cast<double>(tree.GetProxies().capacity() * sizeof(LinearTree::Proxy)) / static_cast<double>(count);
+		state.SetItemsProcessed(state.iterations() * count);
+		state.SetLabel(workload_names[workload]);
+	}
+}
+
+BENCHMARK(BM_Insert)
+	->ArgsProduct({ { Uniform, Clustered, Mixed }, { 10000, 100000, 1000000 } })
+	->ArgNames({ "workload", "objects" })
+	->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_ClearAndInsert)
+	->ArgsProduct({ { Uniform, Clustered, Mixed }, { 10000, 100000, 1000000 } })
+	->ArgNames({ "workload", "objects" })
+	->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_Query)
+	->ArgsProduct({ { Uniform, Clustered, Mixed }, { 10000, 100000, 1000000, 10000000 }, { 4, 64 } })
+	->ArgNames({ "workload", "objects", "half_size" })
+	->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_LinearQuery)
+	->ArgsProduct({ { Uniform, Clustered, Mixed }, { 10000, 100000, 1000000, 10000000 }, { 4, 64 } })
+	->ArgNames({ "workload", "objects", "half_size" })
+	->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_ParallelQuery)
+	->ArgsProduct({ { Uniform, Clustered, Mixed }, { 100000, 1000000 }, { 0, 1, 2, 4, 8, 16, 32 } })
+	->ArgNames({ "workload", "objects", "workers" })
+	->Unit(benchmark::kMillisecond)
+	->UseRealTime();
+
+BENCHMARK(BM_SweptQuery)
+	->ArgsProduct({ { Uniform, Clustered, Mixed }, { 100000, 1000000 }, { 0, 1, 2 } })
+	->ArgNames({ "workload", "objects", "mode" })
+	->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_SelectCut)
+	->ArgsProduct({ { Uniform, Clustered, Mixed }, { 100000, 1000000 }, { 0, 1024 } })
+	->ArgNames({ "workload", "objects", "budget" })
+	->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_OcclusionCull)
+	->ArgsProduct({ { Uniform, Clustered, Mixed }, { 100000, 1000000 }, { 0, 1, 2 } })
+	->ArgNames({ "workload", "objects", "mode" })
+	->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_DeltaExport)
+	->ArgsProduct({ { Uniform, Clustered, Mixed }, { 100000, 1000000 }, { 16, 1024 } })
+	->ArgNames({ "workload", "objects", "changes" })
+	->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_Update)
+	->ArgsProduct({ { Uniform, Clustered, Mixed }, { 10000, 100000, 1000000 } })
+	->ArgNames({ "workload", "objects" });
+
+BENCHMARK(BM_Traverse)
+	->ArgsProduct({ { Uniform, Clustered, Mixed }, { 10000, 100000, 1000000, 10000000 } })
+	->ArgNames({ "workload", "objects" })
+	->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_DebugDraw)
+	->ArgsProduct({ { Uniform, Clustered, Mixed }, { 1000, 10000, 100000 }, { 0, 1 } })
+	->ArgNames({ "workload", "objects", "instanced" })
+	->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_LinearTraverse)
+	->ArgsProduct({ { Uniform, Clustered, Mixed }, { 10000, 100000, 1000000, 10000000 } })
+	->ArgNames({ "workload", "objects" })
+	->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
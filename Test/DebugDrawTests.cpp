@@ -0,0 +1,92 @@
+#include <cstring>
+
+#include <gtest/gtest.h>
+
+#include "DebugDraw.h"
+
+namespace
+{
+	const AABB unit_box(vec3{ 0.0f, 0.0f, 0.0f }, vec3{ 1.0f, 2.0f, 3.0f });
+	const vec3 red{ 1.0f, 0.0f, 0.0f };
+}
+
+TEST(DebugDrawList, BoxGeometry)
+{
+	DebugDrawList list;
+	list.AddBox(unit_box, red);
+
+	ASSERT_EQ(8u, list.GetVertexCount());
+	ASSERT_EQ(24u, list.GetIndexCount());
+	EXPECT_FALSE(list.Uses32BitIndices());
+	EXPECT_EQ(sizeof(uint16_t), list.GetIndexSize());
+
+	// every edge joins two corners differing in exactly one coordinate
+	auto& vertices = list.GetVertices();
+	auto indices = static_cast<const uint16_t*>(list.GetIndexData());
+	for (size_t i = 0; i < 24; i += 2)
+	{
+		auto& a = vertices[indices[i]];
+		auto& b = vertices[indices[i + 1]];
+		int differ = (a.x != b.x) + (a.y != b.y) + (a.z != b.z);
+		EXPECT_EQ(1, differ);
+		EXPECT_EQ(1.0f, a.r);
+	}
+}
+
+TEST(DebugDrawList, SwitchesTo32BitIndices)
+{
+	DebugDrawList list;
+
+	// 8192 boxes still fit 16 bit indices, the next one does not
+	for (int i = 0; i < 8192; i++)
+		list.AddBox(unit_box, red);
+	EXPECT_FALSE(list.Uses32BitIndices());
+
+	list.AddBox(unit_box, red);
+	list.AddLine(vec3{ 0.0f, 0.0f, 0.0f }, vec3{ 1.0f, 1.0f, 1.0f }, red);
+	ASSERT_TRUE(list.Uses32BitIndices());
+	ASSERT_EQ(8193u * 24 + 2, list.GetIndexCount());
+
+	auto indices = static_cast<const uint32_t*>(list.GetIndexData());
+	EXPECT_EQ(7u, indices[23]);
+	EXPECT_EQ(8192u * 8, indices[8192 * 24]);
+	EXPECT_EQ(8193u * 8 + 1, indices[list.GetIndexCount() - 1]);
+	for (size_t i = 0; i < list.GetIndexCount(); i++)
+		ASSERT_LT(indices[i], list.GetVertexCount());
+
+	list.Clear();
+	EXPECT_FALSE(list.Uses32BitIndices());
+	EXPECT_EQ(0u, list.GetIndexCount());
+	EXPECT_EQ(0u, list.GetByteSize());
+}
+
+TEST(DebugDrawList, InstancedBoxes)
+{
+	DebugDrawList lines, instanced(true);
+	for (int i = 0; i < 1000; i++)
+	{
+		lines.AddBox(unit_box, red);
+		instanced.AddBox(unit_box, red);
+	}
+
+	EXPECT_EQ(0u, instanced.GetVertexCount());
+	ASSERT_EQ(1000u, instanced.GetInstances().size());
+
+	auto& box = instanced.GetInstances().front();
+	EXPECT_EQ(0.5f, box.center[0]);
+	EXPECT_EQ(1.5f, box.halfSize[2]);
+	EXPECT_EQ(0xff0000ffu, box.color);
+
+	// scaling the shared cube by the instance gives the corners of the box
+	auto cube = DebugDrawList::GetUnitBoxVertices();
+	for (size_t i = 0; i < DebugDrawList::unit_box_vertex_count; i++)
+	{
+		auto& v = lines.GetVertices()[i];
+		EXPECT_EQ(v.x, box.center[0] + cube[i].x * box.halfSize[0]);
+		EXPECT_EQ(v.y, box.center[1] + cube[i].y * box.halfSize[1]);
+		EXPECT_EQ(v.z, box.center[2] + cube[i].z * box.halfSize[2]);
+	}
+	EXPECT_EQ(0, std::memcmp(DebugDrawList::GetUnitBoxIndices(), lines.GetIndexData(), 24 * sizeof(uint16_t)));
+
+	EXPECT_GE(lines.GetByteSize(), instanced.GetByteSize() * 8);
+}
@@ -0,0 +1,127 @@
+#include <random>
+#include <set>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "OcclusionCuller.h"
+#include "Octree.h"
+
+namespace
+{
+	struct Obj
+	{
+		AABB	aabb;
+		const AABB& GetAABB() const { return aabb; }
+	};
+
+	const float half_pi = 3.1415926f * 0.5f;
+
+	AABB cube(const vec3& c, float halfSize) { return AABB(c, halfSize); }
+
+	// camera at the origin looking down +z, a wall across the view at z = 10
+	OcclusionCuller make_culler()
+	{
+		OcclusionCuller culler(128, 64);
+		culler.SetCamera(vec3{ 0.0f, 0.0f, 0.0f }, vec3{ 0.0f, 0.0f, 1.0f }, half_pi, 0.1f, 100.0f);
+		return culler;
+	}
+
+	const AABB wall(vec3{ -4.0f, -4.0f, 10.0f }, vec3{ 4.0f, 4.0f, 11.0f });
+}
+
+TEST(Matrix4, LookToPerspectiveLH)
+{
+	Matrix4 m =
+		Matrix4::LookToLH(vec3{ 1.0f, 2.0f, 3.0f }, vec3{ 1.0f, 0.0f, 0.0f }, vec3{ 0.0f, 1.0f, 0.0f }) *
+		Matrix4::PerspectiveFovLH(half_pi, 2.0f, 1.0f, 10.0f);
+
+	// straight ahead lands in the centre, the near and far planes at depth 0 and 1
+	vec4 n = m.Transform(vec3{ 2.0f, 2.0f, 3.0f });
+	EXPECT_NEAR(0.0f, n.x / n.w, 1e-6f);
+	EXPECT_NEAR(0.0f, n.y / n.w, 1e-6f);
+	EXPECT_NEAR(0.0f, n.z / n.w, 1e-6f);
+
+	vec4 f = m.Transform(vec3{ 11.0f, 2.0f, 3.0f });
+	EXPECT_NEAR(1.0f, f.z / f.w, 1e-6f);
+	EXPECT_FLOAT_EQ(10.0f, f.w);
+
+	// a 90 degree vertical field of view puts the top edge at 45 degrees, x is halved by the aspect
+	vec4 top = m.Transform(vec3{ 6.0f, 7.0f, 3.0f });
+	EXPECT_NEAR(1.0f, top.y / top.w, 1e-6f);
+	vec4 side = m.Transform(vec3{ 6.0f, 2.0f, 3.0f - 5.0f });
+	EXPECT_NEAR(0.5f, side.x / side.w, 1e-6f);
+}
+
+TEST(OcclusionCuller, WallHidesBoxesBehindIt)
+{
+	OcclusionCuller culler = make_culler();
+	EXPECT_TRUE(culler.IsVisible(cube(vec3{ 0.0f, 0.0f, 20.0f }, 1.0f)));
+
+	culler.AddOccluder(wall);
+
+	// the depth behind the wall centre is that of its front face
+	float wall_depth = culler.GetDepth(64, 32);
+	EXPECT_LT(wall_depth, 1.0f);
+	EXPECT_GT(wall_depth, 0.0f);
+	EXPECT_EQ(1.0f, culler.GetDepth(0, 0));
+
+	EXPECT_FALSE(culler.IsVisible(cube(vec3{ 0.0f, 0.0f, 20.0f }, 1.0f)));
+	EXPECT_FALSE(culler.IsVisible(cube(vec3{ 1.0f, -1.0f, 15.0f }, 2.0f)));
+
+	// in front of the wall, poking out beside it, outside the view or around the eye
+	EXPECT_TRUE(culler.IsVisible(cube(vec3{ 0.0f, 0.0f, 5.0f }, 1.0f)));
+	EXPECT_TRUE(culler.IsVisible(cube(vec3{ 6.0f, 0.0f, 20.0f }, 3.0f)));
+	EXPECT_FALSE(culler.IsVisible(cube(vec3{ 0.0f, 0.0f, -20.0f }, 1.0f)));
+	EXPECT_FALSE(culler.IsVisible(cube(vec3{ 0.0f, 0.0f, 200.0f }, 1.0f)));
+	EXPECT_TRUE(culler.IsVisible(cube(vec3{ 0.0f, 0.0f, 0.0f }, 1.0f)));
+
+	culler.Clear();
+	EXPECT_TRUE(culler.IsVisible(cube(vec3{ 0.0f, 0.0f, 20.0f }, 1.0f)));
+}
+
+TEST(OcclusionCuller, QueryVisibleMatchesPerObjectTest)
+{
+	std::mt19937 rng(21);
+	std::uniform_real_distribution<float> pos(-30.0f, 30.0f);
+	std::uniform_real_distribution<float> size(0.1f, 1.0f);
+
+	std::vector<Obj> objects(2000);
+	for (auto& o : objects)
+		o.aabb = cube(vec3{ pos(rng), pos(rng), pos(rng) + 30.0f }, size(rng));
+
+	Octree<Obj, 5> tree(vec3{ 0.0f, 0.0f, 30.0f }, 32.0f);
+	for (auto& o : objects)
+		tree.Insert(&o);
+
+	OcclusionCuller culler = make_culler();
+	culler.AddOccluder(wall);
+
+	// hidden subtrees only ever hold hidden objects
+	std::set<const Obj*> visible;
+	culler.QueryVisible(tree, [&visible](Obj* o) { EXPECT_TRUE(visible.insert(o).second); return false; });
+
+	std::set<const Obj*> expected;
+	for (auto& o : objects)
+	{
+		if (culler.IsVisible(o.aabb))
+			expected.insert(&o);
+	}
+	EXPECT_EQ(expected, visible);
+
+	OcclusionCuller open = make_culler();
+	size_t in_view = 0;
+	for (auto& o : objects)
+		in_view += open.IsVisible(o.aabb) ? 1 : 0;
+	EXPECT_LT(visible.size(), in_view);
+
+	// objects drawn as occluders on the way hide more, never the ones in front of them
+	std::vector<const Obj*> order;
+	culler.Clear();
+	culler.AddOccluder(wall);
+	culler.QueryVisible(tree, [&order](Obj* o) { order.push_back(o); return true; });
+
+	EXPECT_LE(order.size(), visible.size());
+	for (auto o : order)
+		EXPECT_TRUE(expected.count(o));
+}
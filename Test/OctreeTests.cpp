@@ -0,0 +1,928 @@
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "LinearOctree.h"
+#include "Octree.h"
+#include "OctreeLod.h"
+#include "PointOctree.h"
+#include "VoxelOctree.h"
+
+namespace
+{
+	struct Obj
+	{
+		AABB	aabb;
+		const AABB& GetAABB() const { return aabb; }
+	};
+
+	struct dObj
+	{
+		dAABB	aabb;
+		const dAABB& GetAABB() const { return aabb; }
+	};
+
+	constexpr float world_half_size = 64.0f;
+
+	AABB random_box(std::mt19937& rng, float maxHalfSize)
+	{
+		std::uniform_real_distribution<float> pos(-world_half_size, world_half_size);
+		std::uniform_real_distribution<float> size(0.01f, maxHalfSize);
+
+		vec3 c{ pos(rng), pos(rng), pos(rng) };
+		vec3 h{ size(rng), size(rng), size(rng) };
+		vec3 lo = c - h, hi = c + h;
+		lo = vec3{ std::max(lo.x, -world_half_size), std::max(lo.y, -world_half_size), std::max(lo.z, -world_half_size) };
+		hi = vec3{ std::min(hi.x, world_half_size), std::min(hi.y, world_half_size), std::min(hi.z, world_half_size) };
+		return AABB(lo, hi);
+	}
+
+	std::vector<Obj> random_objects(size_t count, unsigned seed)
+	{
+		std::mt19937 rng(seed);
+		std::vector<Obj> objects(count);
+		for (auto& o : objects)
+			o.aabb = random_box(rng, rng() % 8 == 0 ? 16.0f : 1.0f);
+		return objects;
+	}
+
+	template<typename O, typename Tree>
+	std::set<const O*> query(const Tree& tree, const AABB& box)
+	{
+		std::set<const O*> result;
+		tree.Query(box, [&result](O* o) { EXPECT_TRUE(result.insert(o).second) << "object reported twice"; });
+		return result;
+	}
+
+	template<typename O>
+	std::set<const O*> brute_force(const std::vector<O>& objects, const AABB& box)
+	{
+		std::set<const O*> result;
+		for (auto& o : objects)
+		{
+			if (AABB(o.GetAABB()).Intersects(box))
+				result.insert(&o);
+		}
+		return result;
+	}
+
+	// inserts every object, then checks random queries against a linear scan
+	template<typename Tree>
+	void compare_with_brute_force(Tree& tree, std::vector<Obj>& objects)
+	{
+		for (auto& o : objects)
+			tree.Insert(&o);
+		ASSERT_TRUE(tree.Validate());
+
+		size_t count = 0;
+		for (Obj* o : tree)
+		{
+			(void)o;
+			count++;
+		}
+		ASSERT_EQ(objects.size(), count);
+
+		std::mt19937 rng(7);
+		for (int i = 0; i < 200; i++)
+		{
+			AABB box = random_box(rng, i % 2 ? 4.0f : 24.0f);
+			ASSERT_EQ(brute_force(objects, box), query<Obj>(tree, box));
+		}
+	}
+}
+
+TEST(AABB, ContainsAndIntersects)
+{
+	AABB a(vec3{ 0.0f, 0.0f, 0.0f }, vec3{ 2.0f, 2.0f, 2.0f });
+
+	EXPECT_TRUE(a.Contains(vec3{ 1.0f, 1.0f, 1.0f }));
+	EXPECT_FALSE(a.Contains(vec3{ 1.0f, 1.0f, 3.0f }));
+	EXPECT_TRUE(a.Contains(AABB(vec3{ 0.5f, 0.5f, 0.5f }, vec3{ 1.5f, 1.5f, 1.5f })));
+	EXPECT_FALSE(a.Contains(AABB(vec3{ 0.5f, 0.5f, -0.5f }, vec3{ 1.5f, 1.5f, 1.5f })));
+
+	EXPECT_TRUE(a.Intersects(AABB(vec3{ 1.0f, 1.0f, 1.0f }, vec3{ 3.0f, 3.0f, 3.0f })));
+	EXPECT_TRUE(a.Intersects(AABB(vec3{ 2.0f, 2.0f, 2.0f }, vec3{ 3.0f, 3.0f, 3.0f })));
+	EXPECT_FALSE(a.Intersects(AABB(vec3{ 1.0f, 1.0f, 2.5f }, vec3{ 3.0f, 3.0f, 3.0f })));
+
+	AABB u = a.Union(AABB(vec3{ -1.0f, 0.0f, 0.0f }, vec3{ 0.0f, 3.0f, 1.0f }));
+	EXPECT_EQ(-1.0f, u.min.x);
+	EXPECT_EQ(3.0f, u.max.y);
+	EXPECT_EQ(2.0f, u.max.z);
+}
+
+TEST(Octree, QueryMatchesBruteForce)
+{
+	auto objects = random_objects(2000, 1);
+	Octree<Obj, 6> tree(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size);
+	compare_with_brute_force(tree, objects);
+}
+
+TEST(Octree, QueryMatchesBruteForceWithConfig)
+{
+	OctreeConfig configs[4];
+	configs[0].maxDepth = 5;
+	configs[1].bucketSize = 8;
+	configs[1].minNodeSize = 2.0f;
+	configs[2].looseness = 2.0f;
+	configs[3].quantised = true;
+
+	for (auto& config : configs)
+	{
+		auto objects = random_objects(2000, 2);
+		Octree<Obj, OCTREE_DYNAMIC_DEPTH> tree(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size, config);
+		compare_with_brute_force(tree, objects);
+	}
+}
+
+TEST(Octree, BucketSplitsFullLeaves)
+{
+	OctreeConfig config;
+	config.bucketSize = 8;
+
+	std::mt19937 rng(4);
+	std::uniform_real_distribution<float> pos(-world_half_size + 1.0f, world_half_size - 1.0f);
+	std::vector<Obj> objects(2000);
+	for (auto& o : objects)
+		o.aabb = AABB(vec3{ pos(rng), pos(rng), pos(rng) }, 0.1f);
+
+	typedef Octree<Obj, 6> Tree;
+	Tree tree(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size, config);
+	for (auto& o : objects)
+		tree.Insert(&o);
+	ASSERT_TRUE(tree.Validate());
+
+	size_t interior = 0;
+	for (auto node : tree.Nodes())
+	{
+		if (node->IsLeaf())
+			continue;
+
+		// only objects that fit no child stay above the leaves
+		for (auto p = node->objects; nullptr != p; p = p->next)
+		{
+			interior++;
+			for (size_t i = 0; i < 8; i++)
+			{
+				NodeBoundingBox child = node->GetChildBound(i);
+				EXPECT_FALSE(AABB(child.center, child.halfSize).Contains(p->GetAABB()));
+			}
+		}
+	}
+	EXPECT_LT(interior, objects.size() / 10);
+
+	// boxes across the root centre fit no child and stay in a root that remains a leaf
+	std::uniform_real_distribution<float> jitter(-0.5f, 0.5f);
+	std::vector<Obj> straddling(4000);
+	for (auto& o : straddling)
+		o.aabb = AABB(vec3{ jitter(rng), jitter(rng), jitter(rng) }, 1.0f);
+
+	Tree centre(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size, config);
+	for (auto& o : straddling)
+		centre.Insert(&o);
+	ASSERT_TRUE(centre.Validate());
+	EXPECT_TRUE(centre.GetRoot()->IsLeaf());
+	EXPECT_EQ(straddling.size(), centre.GetRoot()->count);
+}
+
+TEST(Octree, QueryMatchesBruteForceWithTightBounds)
+{
+	auto objects = random_objects(2000, 3);
+	Octree<Obj, 6, TightBoundsAggregate> tree(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size);
+	compare_with_brute_force(tree, objects);
+
+	// the root aggregate is the union of everything inserted
+	AABB all = TightBoundsAggregate::Empty();
+	for (auto& o : objects)
+		all = all.Union(o.aabb);
+	const AABB& root = tree.GetRoot()->aggregate;
+	EXPECT_EQ(all.min.x, root.min.x);
+	EXPECT_EQ(all.min.y, root.min.y);
+	EXPECT_EQ(all.min.z, root.min.z);
+	EXPECT_EQ(all.max.x, root.max.x);
+	EXPECT_EQ(all.max.y, root.max.y);
+	EXPECT_EQ(all.max.z, root.max.z);
+}
+
+namespace
+{
+	struct LayeredObj
+	{
+		AABB		aabb;
+		uint32_t	layers;
+		const AABB& GetAABB() const { return aabb; }
+	};
+
+	// union of the layer bits in a subtree
+	struct LayerAggregate
+	{
+		typedef uint32_t value_type;
+
+		static inline value_type Empty() { return 0; }
+
+		template<typename T>
+		static inline value_type FromObject(const T& object) { return object.layers; }
+
+		static inline value_type Combine(value_type a, value_type b) { return a | b; }
+	};
+}
+
+TEST(Octree, QueryPrunesOnAggregate)
+{
+	// layer 1 for everything, layer 2 for the objects at x > 0, layer 4 for a rare few
+	auto plain = random_objects(4000, 13);
+	std::vector<LayeredObj> objects(plain.size());
+	for (size_t i = 0; i < plain.size(); i++)
+	{
+		const vec3 c = (plain[i].aabb.min + plain[i].aabb.max) * 0.5f;
+		objects[i] = LayeredObj{ plain[i].aabb, 1u | (c.x > 0.0f ? 2u : 0u) | (0 == i % 200 ? 4u : 0u) };
+	}
+
+	Octree<LayeredObj, 6, LayerAggregate> tree(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size);
+	for (auto& o : objects)
+		tree.Insert(&o);
+	ASSERT_TRUE(tree.Validate());
+	EXPECT_EQ(7u, tree.GetRoot()->aggregate);
+
+	std::mt19937 rng(17);
+	for (int i = 0; i < 100; i++)
+	{
+		const uint32_t wanted = 1u << (i % 3);
+		const AABB box = i < 3 ? AABB(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size) : random_box(rng, 24.0f);
+
+		std::set<const LayeredObj*> expected, found;
+		for (auto& o : objects)
+		{
+			if (o.aabb.Intersects(box) && 0 != (o.layers & wanted))
+				expected.insert(&o);
+		}
+
+		size_t filterCalls = 0;
+		auto filter = [wanted, &filterCalls](uint32_t layers) { filterCalls++; return 0 != (layers & wanted); };
+		tree.Query(box, filter, [&found](LayeredObj* o) { EXPECT_TRUE(found.insert(o).second); });
+		ASSERT_EQ(expected, found);
+
+		// subtrees without a rare object are skipped whole, their objects never reach the filter
+		if (2 == i)
+		{
+			EXPECT_LT(filterCalls, objects.size() / 2);
+		}
+	}
+}
+
+TEST(Octree, DoublePrecisionFarFromOrigin)
+{
+	const dvec3 center{ 1.0e7, -3.0e6, 5.0e5 };
+	Octree<dObj, 10> tree(center, 1024.0);
+
+	std::vector<dObj> objects(500);
+	std::mt19937 rng(4);
+	std::uniform_real_distribution<double> pos(-1000.0, 1000.0);
+	for (auto& o : objects)
+	{
+		dvec3 c = center + dvec3{ pos(rng), pos(rng), pos(rng) };
+		o.aabb = dAABB(c, 0.01);
+		tree.Insert(&o);
+	}
+
+	for (auto& o : objects)
+	{
+		size_t hits = 0;
+		tree.Query(dAABB(o.aabb.min, o.aabb.max), [&hits, &o](dObj* p) { hits += &o == p; });
+		EXPECT_EQ(1u, hits);
+	}
+}
+
+TEST(Octree, RebaseKeepsQueriesExact)
+{
+	const dvec3 center{ 1.0e7, -3.0e6, 5.0e5 };
+	typedef Octree<dObj, 8, dTightBoundsAggregate> Tree;
+	Tree tree(center, 1024.0);
+
+	std::vector<dObj> objects(1000);
+	std::mt19937 rng(6);
+	std::uniform_real_distribution<double> pos(-1000.0, 1000.0);
+	std::uniform_real_distribution<double> size(0.01, 8.0);
+	for (auto& o : objects)
+	{
+		o.aabb = dAABB(center + dvec3{ pos(rng), pos(rng), pos(rng) }, size(rng));
+		tree.Insert(&o);
+	}
+
+	// the camera moves next to the tree centre, which becomes the new origin
+	const dvec3 offset = center + dvec3{ 3.0, -2.0, 1.0 };
+	for (auto& o : objects)
+		o.aabb = dAABB(o.aabb.min - offset, o.aabb.max - offset);
+	tree.Rebase(offset);
+	ASSERT_TRUE(tree.Validate());
+
+	const dvec3 moved = tree.GetRoot()->bound.center;
+	EXPECT_DOUBLE_EQ(-3.0, moved.x);
+	EXPECT_DOUBLE_EQ(2.0, moved.y);
+	EXPECT_DOUBLE_EQ(-1.0, moved.z);
+
+	// aggregates follow the shifted objects
+	const dAABB& aggregate = tree.GetRoot()->aggregate;
+	for (auto& o : objects)
+		ASSERT_TRUE(aggregate.Contains(o.aabb));
+
+	for (int i = 0; i < 100; i++)
+	{
+		const dAABB box(dvec3{ pos(rng), pos(rng), pos(rng) }, 20.0 + 2.0 * i);
+
+		std::set<const dObj*> expected, found;
+		for (auto& o : objects)
+		{
+			if (o.aabb.Intersects(box))
+				expected.insert(&o);
+		}
+		tree.Query(box, [&found](dObj* o) { EXPECT_TRUE(found.insert(o).second); });
+		ASSERT_EQ(expected, found);
+	}
+
+	// the float local bound of the root is centred on the new origin
+	const AABB local = tree.GetLocalBound(tree.GetRoot(), dvec3{ 0.0, 0.0, 0.0 });
+	EXPECT_FLOAT_EQ(-3.0f, (local.min.x + local.max.x) * 0.5f);
+	EXPECT_FLOAT_EQ(1024.0f, (local.max.y - local.min.y) * 0.5f);
+
+	// the rebased tree keeps working for removes and inserts
+	for (size_t i = 0; i < objects.size(); i += 2)
+		ASSERT_TRUE(tree.Remove(&objects[i]));
+	EXPECT_TRUE(tree.Validate());
+}
+
+TEST(Octree, RemoveAndReinsert)
+{
+	auto objects = random_objects(1000, 5);
+	Octree<Obj, 6> tree(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size);
+	for (auto& o : objects)
+		tree.Insert(&o);
+
+	for (size_t i = 0; i < objects.size(); i += 2)
+		ASSERT_TRUE(tree.Remove(&objects[i]));
+	EXPECT_FALSE(tree.Remove(&objects[0]));
+	EXPECT_TRUE(tree.Validate());
+
+	AABB all(vec3{ -world_half_size, -world_half_size, -world_half_size }, vec3{ world_half_size, world_half_size, world_half_size });
+	auto remaining = query<Obj>(tree, all);
+	ASSERT_EQ(objects.size() / 2, remaining.size());
+	for (size_t i = 1; i < objects.size(); i += 2)
+		EXPECT_EQ(1u, remaining.count(&objects[i]));
+
+	for (size_t i = 0; i < objects.size(); i += 2)
+		tree.Insert(&objects[i]);
+	EXPECT_EQ(objects.size(), query<Obj>(tree, all).size());
+}
+
+TEST(Octree, RebuildDropsObjectsOutside)
+{
+	auto objects = random_objects(1000, 6);
+	Octree<Obj, 6> tree(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size);
+	for (auto& o : objects)
+		tree.Insert(&o);
+
+	const vec3 center{ world_half_size * 0.5f, world_half_size * 0.5f, world_half_size * 0.5f };
+	const float halfSize = world_half_size * 0.5f;
+	AABB bound(center, halfSize);
+
+	size_t outside = 0;
+	for (auto& o : objects)
+		outside += bound.Contains(o.aabb) ? 0 : 1;
+
+	EXPECT_EQ(outside, tree.Rebuild(center, halfSize));
+	EXPECT_TRUE(tree.Validate());
+
+	size_t count = 0;
+	for (Obj* o : tree)
+	{
+		EXPECT_TRUE(bound.Contains(o->aabb));
+		count++;
+	}
+	EXPECT_EQ(objects.size() - outside, count);
+}
+
+TEST(Octree, ClearReusesStorage)
+{
+	auto objects = random_objects(2000, 12);
+	Octree<Obj, 6, TightBoundsAggregate> tree(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size);
+
+	for (int frame = 0; frame < 3; frame++)
+	{
+		for (auto& o : objects)
+			tree.Insert(&o);
+		ASSERT_TRUE(tree.Validate());
+
+		AABB all(vec3{ -world_half_size, -world_half_size, -world_half_size }, vec3{ world_half_size, world_half_size, world_half_size });
+		ASSERT_EQ(objects.size(), query<Obj>(tree, all).size());
+
+		tree.Clear();
+		ASSERT_TRUE(tree.Validate());
+		EXPECT_TRUE(tree.GetRoot()->IsLeaf());
+		EXPECT_EQ(nullptr, tree.GetRoot()->objects);
+		EXPECT_TRUE(tree.begin() == tree.end());
+		EXPECT_TRUE(query<Obj>(tree, all).empty());
+	}
+}
+
+TEST(Octree, ValidateDetectsBrokenLinks)
+{
+	auto objects = random_objects(200, 10);
+	Octree<Obj, 4> tree(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size);
+	for (auto& o : objects)
+		tree.Insert(&o);
+	ASSERT_TRUE(tree.Validate());
+
+	auto node = const_cast<Octree<Obj, 4>::Node*>(*++tree.Nodes().begin());
+	auto parent = node->parent;
+	node->parent = nullptr;
+	EXPECT_FALSE(tree.Validate());
+	node->parent = parent;
+
+	Obj outside{ AABB(vec3{ 100.0f, 100.0f, 100.0f }, vec3{ 101.0f, 101.0f, 101.0f }) };
+	OctreeData<Obj> entry{ nullptr, &outside };
+	node->Insert(&entry);
+	EXPECT_FALSE(tree.Validate());
+	EXPECT_EQ(&entry, node->Unlink(&outside));
+	EXPECT_TRUE(tree.Validate());
+}
+
+#ifdef OCTREE_ENABLE_STATS
+TEST(Octree, Stats)
+{
+	auto objects = random_objects(2000, 11);
+	Octree<Obj, 6> tree(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size);
+	for (auto& o : objects)
+		tree.Insert(&o);
+
+	OctreeStats stats = tree.GetStats();
+	EXPECT_EQ(objects.size(), stats.objectCount);
+	EXPECT_EQ(1u, stats.nodesPerLevel[0]);
+	EXPECT_LE(stats.nodesPerLevel.size(), 7u);
+
+	size_t nodes = 0, histogram = 0;
+	for (size_t n : stats.nodesPerLevel)
+		nodes += n;
+	for (size_t n : stats.objectsPerNode)
+		histogram += n;
+	EXPECT_EQ(stats.nodeCount, nodes);
+	EXPECT_EQ(stats.nodeCount, histogram);
+	EXPECT_GT(stats.memoryBytes, objects.size() * sizeof(OctreeData<Obj>));
+	EXPECT_GE(stats.reservedBytes, stats.memoryBytes);
+
+	tree.ResetQueryStats();
+	AABB box(vec3{ -8.0f, -8.0f, -8.0f }, vec3{ 8.0f, 8.0f, 8.0f });
+	auto found = query<Obj>(tree, box);
+
+	const OctreeQueryStats q = tree.GetQueryStats();
+	EXPECT_EQ(1u, q.queries);
+	EXPECT_EQ(found.size(), q.hits);
+	EXPECT_GE(q.aabbTests, q.nodesVisited + q.hits);
+	EXPECT_LE(q.nodesVisited, stats.nodeCount);
+
+	// const queries from several threads all count, and the counting itself does not race
+	tree.ResetQueryStats();
+	std::vector<std::thread> readers;
+	for (int t = 0; t < 4; t++)
+	{
+		readers.emplace_back([&tree, &box]()
+		{
+			for (int i = 0; i < 50; i++)
+				tree.Query(box, [](Obj*) {});
+		});
+	}
+	for (auto& reader : readers)
+		reader.join();
+
+	const OctreeQueryStats concurrent = tree.GetQueryStats();
+	EXPECT_EQ(200u, concurrent.queries);
+	EXPECT_EQ(200u * found.size(), concurrent.hits);
+	EXPECT_EQ(200u * q.nodesVisited, concurrent.nodesVisited);
+}
+#endif
+
+TEST(Octree, NodeIterationOrders)
+{
+	auto objects = random_objects(500, 8);
+	Octree<Obj, 5> tree(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size);
+	for (auto& o : objects)
+		tree.Insert(&o);
+
+	std::vector<const Octree<Obj, 5>::Node*> depthFirst, breadthFirst;
+	for (auto node : tree.Nodes())
+		depthFirst.push_back(node);
+	for (auto node : tree.NodesBreadthFirst())
+		breadthFirst.push_back(node);
+
+	ASSERT_FALSE(depthFirst.empty());
+	EXPECT_EQ(tree.GetRoot(), depthFirst.front());
+	EXPECT_EQ(tree.GetRoot(), breadthFirst.front());
+
+	// every parent comes before its children
+	for (size_t i = 1; i < depthFirst.size(); i++)
+	{
+		auto parent = depthFirst[i]->parent;
+		EXPECT_NE(depthFirst.begin() + i, std::find(depthFirst.begin(), depthFirst.begin() + i, parent));
+	}
+
+	std::sort(depthFirst.begin(), depthFirst.end());
+	std::sort(breadthFirst.begin(), breadthFirst.end());
+	EXPECT_EQ(depthFirst, breadthFirst);
+}
+
+TEST(Octree, FaceNeighbors)
+{
+	// a single small object forces a full path to the deepest level near the centre
+	Obj o{ AABB(vec3{ 0.1f, 0.1f, 0.1f }, vec3{ 0.2f, 0.2f, 0.2f }) };
+	Obj p{ AABB(vec3{ -0.2f, 0.1f, 0.1f }, vec3{ -0.1f, 0.2f, 0.2f }) };
+	Octree<Obj, 4> tree(vec3{ 0.0f, 0.0f, 0.0f }, 8.0f);
+	tree.Insert(&o);
+	tree.Insert(&p);
+
+	const Octree<Obj, 4>::Node* node = nullptr;
+	for (auto n : tree.Nodes())
+	{
+		if (nullptr != n->objects && n->objects->object == &o)
+			node = n;
+	}
+	ASSERT_NE(nullptr, node);
+
+	auto west = Octree<Obj, 4>::FindNeighbor(node, ivec3{ -1, 0, 0 });
+	ASSERT_NE(nullptr, west);
+	ASSERT_NE(nullptr, west->objects);
+	EXPECT_EQ(&p, west->objects->object);
+
+	// only existing nodes that do not contain node are reported
+	size_t count = 0, seen = 0;
+	Octree<Obj, 4>::ForEachNeighbor(node, [&](const Octree<Obj, 4>::Node* n, const ivec3&)
+	{
+		count++;
+		seen += n == west;
+		EXPECT_FALSE(AABB(n->bound).Contains(node->bound.center));
+	});
+	EXPECT_EQ(1u, seen);
+	EXPECT_LE(count, 6u);
+}
+
+TEST(Octree, QueryParallelMatchesSerial)
+{
+	auto objects = random_objects(5000, 5);
+	Octree<Obj, 6> tree(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size);
+	for (auto& o : objects)
+		tree.Insert(&o);
+
+	std::mt19937 rng(11);
+	for (size_t workers : { 1, 3, 8 })
+	{
+		OctreeWorkerPool pool(workers);
+		ASSERT_EQ(workers, pool.GetWorkerCount());
+
+		for (int cutoff : { 0, 1, 3, 6 })
+		{
+			for (int i = 0; i < 20; i++)
+			{
+				AABB box = random_box(rng, i % 2 ? 8.0f : 48.0f);
+
+				std::vector<Obj*> hits;
+				tree.QueryParallel(box, hits, pool, cutoff);
+
+				std::set<const Obj*> result(hits.begin(), hits.end());
+				EXPECT_EQ(hits.size(), result.size()) << "object reported twice";
+				ASSERT_EQ(query<Obj>(tree, box), result);
+			}
+		}
+	}
+}
+
+// the float types may run on SIMD registers, the double ones always take the generic code
+TEST(AABB, FloatMatchesGenericScalar)
+{
+	std::mt19937 rng(3);
+	for (int i = 0; i < 2000; i++)
+	{
+		AABB a = random_box(rng, 16.0f), b = random_box(rng, 16.0f);
+		dAABB da(a), db(b);
+
+		EXPECT_EQ(da.Intersects(db), a.Intersects(b));
+		EXPECT_EQ(da.Contains(db), a.Contains(b));
+		EXPECT_EQ(db.Contains(da), b.Contains(a));
+
+		AABB u = a.Union(b);
+		dAABB du = da.Union(db);
+		EXPECT_EQ(static_cast<float>(du.min.y), u.min.y);
+		EXPECT_EQ(static_cast<float>(du.max.z), u.max.z);
+
+		vec3 c = (a.min + b.max) * 0.5f - b.min;
+		EXPECT_FLOAT_EQ((a.min.x + b.max.x) * 0.5f - b.min.x, c.x);
+		EXPECT_FLOAT_EQ((a.min.z + b.max.z) * 0.5f - b.min.z, c.z);
+
+		AABB cube(c, 2.0f);
+		EXPECT_EQ(c.y - 2.0f, cube.min.y);
+		EXPECT_EQ(c.x + 2.0f, cube.max.x);
+	}
+
+	// a box touching another in one face still intersects it
+	EXPECT_TRUE(AABB(vec3{ 0.0f, 0.0f, 0.0f }, 1.0f).Intersects(AABB(vec3{ 2.0f, 0.0f, 0.0f }, 1.0f)));
+}
+
+TEST(AABB, Sweep)
+{
+	AABB moving(vec3{ 0.0f, 0.0f, 0.0f }, vec3{ 1.0f, 1.0f, 1.0f });
+	AABB wall(vec3{ 5.0f, -1.0f, -1.0f }, vec3{ 5.5f, 2.0f, 2.0f });
+
+	float t0 = -1.0f, t1 = -1.0f;
+	ASSERT_TRUE(moving.Sweep(vec3{ 8.0f, 0.0f, 0.0f }, wall, t0, t1));
+	EXPECT_FLOAT_EQ(0.5f, t0);
+	EXPECT_FLOAT_EQ(5.5f / 8.0f, t1);
+
+	// thin geometry between the start and end boxes is still found
+	ASSERT_TRUE(moving.Sweep(vec3{ -8.0f, 0.0f, 0.0f }, AABB(vec3{ -4.0f, 0.0f, 0.0f }, vec3{ -3.99f, 1.0f, 1.0f }), t0, t1));
+	EXPECT_FLOAT_EQ(3.99f / 8.0f, t0);
+
+	EXPECT_FALSE(moving.Sweep(vec3{ 3.5f, 0.0f, 0.0f }, wall, t0, t1));
+	EXPECT_FALSE(moving.Sweep(vec3{ 8.0f, 0.0f, 0.0f }, AABB(vec3{ 5.0f, 3.0f, 0.0f }, vec3{ 6.0f, 4.0f, 1.0f }), t0, t1));
+
+	ASSERT_TRUE(moving.Sweep(vec3{ 0.0f, 0.0f, 0.0f }, moving, t0, t1));
+	EXPECT_EQ(0.0f, t0);
+	EXPECT_EQ(1.0f, t1);
+}
+
+TEST(Octree, QuerySweptInTimeOrder)
+{
+	auto objects = random_objects(3000, 9);
+	Octree<Obj, 6, TightBoundsAggregate> tree(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size);
+	for (auto& o : objects)
+		tree.Insert(&o);
+
+	std::mt19937 rng(13);
+	std::uniform_real_distribution<float> step(-48.0f, 48.0f);
+	for (int i = 0; i < 100; i++)
+	{
+		AABB box = random_box(rng, 2.0f);
+		vec3 delta{ step(rng), step(rng), i % 4 ? step(rng) : 0.0f };
+
+		std::vector<std::pair<float, const Obj*>> expected;
+		for (auto& o : objects)
+		{
+			float t0, t1;
+			if (box.Sweep(delta, o.aabb, t0, t1))
+				expected.emplace_back(t0, &o);
+		}
+		std::sort(expected.begin(), expected.end());
+
+		std::vector<std::pair<float, const Obj*>> found;
+		EXPECT_FALSE(tree.QuerySwept(box, delta, [&found](Obj* o, float t) { found.emplace_back(t, o); return false; }));
+
+		ASSERT_EQ(expected.size(), found.size());
+		EXPECT_TRUE(std::is_sorted(found.begin(), found.end(), [](const std::pair<float, const Obj*>& a, const std::pair<float, const Obj*>& b) { return a.first < b.first; }));
+		std::sort(found.begin(), found.end());
+		EXPECT_EQ(expected, found);
+
+		// confirming the first candidate stops the sweep there
+		size_t calls = 0;
+		float first = -1.0f;
+		bool hit = tree.QuerySwept(box, delta, [&](Obj*, float t) { calls++; first = t; return true; });
+		EXPECT_EQ(!expected.empty(), hit);
+		if (!expected.empty())
+		{
+			EXPECT_EQ(1u, calls);
+			EXPECT_EQ(expected.front().first, first);
+		}
+	}
+}
+
+TEST(Octree, SelectCut)
+{
+	typedef Octree<Obj, 6> Tree;
+
+	auto objects = random_objects(3000, 17);
+	Tree tree(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size);
+	for (auto& o : objects)
+		tree.Insert(&o);
+
+	size_t leaves = 0;
+	for (auto n : tree.Nodes())
+		leaves += n->IsLeaf() ? 1 : 0;
+
+	// every leaf has exactly one cut node among itself and its ancestors
+	auto check_partition = [&](const std::vector<const Tree::Node*>& cut)
+	{
+		std::set<const Tree::Node*> nodes(cut.begin(), cut.end());
+		ASSERT_EQ(cut.size(), nodes.size());
+
+		for (auto n : tree.Nodes())
+		{
+			if (!n->IsLeaf())
+				continue;
+
+			size_t count = 0;
+			for (auto p = n; nullptr != p; p = p->parent)
+				count += nodes.count(p);
+			ASSERT_EQ(1u, count);
+		}
+	};
+
+	OctreeDistanceError metric{ vec3{ 40.0f, 0.0f, 0.0f } };
+
+	std::vector<const Tree::Node*> cut;
+	tree.SelectCut(metric, 0.5f, cut);
+	check_partition(cut);
+	EXPECT_LT(cut.size(), leaves);
+	for (auto n : cut)
+	{
+		EXPECT_TRUE(metric(n) <= 0.5f || n->IsLeaf());
+		if (nullptr != n->parent)
+		{
+			EXPECT_GT(metric(n->parent), 0.5f);
+		}
+	}
+
+	// a budget caps the cut, one that is large enough changes nothing
+	for (size_t budget : { 1, 8, 50, 200 })
+	{
+		std::vector<const Tree::Node*> limited;
+		tree.SelectCut(metric, 0.5f, limited, budget);
+		check_partition(limited);
+		EXPECT_LE(limited.size(), std::max<size_t>(budget, 1));
+	}
+
+	std::vector<const Tree::Node*> unlimited;
+	tree.SelectCut(metric, 0.5f, unlimited, cut.size());
+	EXPECT_EQ(std::set<const Tree::Node*>(cut.begin(), cut.end()), std::set<const Tree::Node*>(unlimited.begin(), unlimited.end()));
+
+	// no error at all keeps the root, nodes around the eye always refine
+	std::vector<const Tree::Node*> coarse;
+	tree.SelectCut([](const Tree::Node*) { return 0.0f; }, 0.0f, coarse);
+	ASSERT_EQ(1u, coarse.size());
+	EXPECT_EQ(tree.GetRoot(), coarse.front());
+
+	OctreeScreenSpaceError screen(vec3{ 0.0f, 0.0f, 0.0f }, 3.1415926f * 0.5f, 720.0f);
+	EXPECT_FLOAT_EQ(360.0f, screen.pixelsPerRadian);
+	EXPECT_EQ(std::numeric_limits<float>::max(), screen(tree.GetRoot()));
+}
+
+TEST(LinearOctree, QueryMatchesBruteForceThroughUpdates)
+{
+	auto objects = random_objects(3000, 13);
+	LinearOctree<Obj, 6> tree(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size);
+	for (auto& o : objects)
+		ASSERT_TRUE(tree.Insert(&o));
+
+	std::vector<bool> alive(objects.size(), true);
+	std::mt19937 rng(14);
+	auto check = [&]()
+	{
+		for (int i = 0; i < 100; i++)
+		{
+			AABB box = random_box(rng, i % 4 ? 6.0f : 48.0f);
+			std::set<const Obj*> expected;
+			for (size_t j = 0; j < objects.size(); j++)
+			{
+				if (alive[j] && objects[j].aabb.Intersects(box))
+					expected.insert(&objects[j]);
+			}
+			ASSERT_EQ(expected, query<Obj>(tree, box));
+		}
+	};
+
+	check();
+
+	// tombstones and an unsorted tail until the next compaction
+	for (size_t i = 0; i < objects.size(); i += 3)
+	{
+		ASSERT_TRUE(tree.Remove(&objects[i]));
+		alive[i] = false;
+	}
+	EXPECT_FALSE(tree.Remove(&objects[0]));
+
+	for (size_t i = 1; i < objects.size(); i += 3)
+	{
+		ASSERT_TRUE(tree.Remove(&objects[i]));
+		objects[i].aabb = random_box(rng, 1.0f);
+		ASSERT_TRUE(tree.Insert(&objects[i]));
+	}
+
+	size_t count = 0;
+	tree.ForEach([&](Obj* o) { EXPECT_TRUE(alive[o - objects.data()]); count++; });
+	EXPECT_EQ(tree.GetCount(), count);
+	EXPECT_EQ(objects.size() - (objects.size() + 2) / 3, count);
+	check();
+
+	tree.Compact();
+	EXPECT_TRUE(tree.IsCompact());
+	EXPECT_EQ(count, tree.GetCount());
+	check();
+
+	// compacted proxies are in Morton order of their nodes
+	auto& proxies = tree.GetProxies();
+	for (size_t i = 1; i < proxies.size(); i++)
+		EXPECT_LE(proxies[i - 1].code, proxies[i].code);
+}
+
+TEST(PointOctree, RadiusQueryMatchesBruteForce)
+{
+	std::mt19937 rng(9);
+	std::uniform_real_distribution<float> pos(-world_half_size, world_half_size);
+
+	PointOctree<6, int> tree(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size);
+	std::vector<vec3> points(5000);
+	for (int i = 0; i < static_cast<int>(points.size()); i++)
+	{
+		points[i] = vec3{ pos(rng), pos(rng), pos(rng) };
+		ASSERT_TRUE(tree.Insert(points[i], i));
+	}
+	EXPECT_EQ(points.size(), tree.GetCount());
+
+	for (int q = 0; q < 50; q++)
+	{
+		vec3 center{ pos(rng), pos(rng), pos(rng) };
+		float radius = 2.0f + static_cast<float>(q);
+
+		std::set<int> expected, found;
+		for (int i = 0; i < static_cast<int>(points.size()); i++)
+		{
+			vec3 d = points[i] - center;
+			if (dot(d, d) <= radius * radius)
+				expected.insert(i);
+		}
+		tree.QueryRadius(center, radius, [&found](const OctreePoint<int>& p) { found.insert(p.payload); });
+		ASSERT_EQ(expected, found);
+	}
+}
+
+TEST(PointOctree, LeavesSplitOnOverflow)
+{
+	std::mt19937 rng(10);
+	std::uniform_real_distribution<float> pos(-world_half_size, world_half_size);
+
+	typedef PointOctree<6> Tree;
+	Tree tree(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size, 8);
+	for (int i = 0; i < 2000; i++)
+		ASSERT_TRUE(tree.Insert(vec3{ pos(rng), pos(rng), pos(rng) }));
+
+	// a pile of equal points can only stop at the deepest level
+	const vec3 pile{ 1.0f, 2.0f, 3.0f };
+	for (int i = 0; i < 20; i++)
+		ASSERT_TRUE(tree.Insert(pile));
+
+	size_t points = 0, deepest = 0;
+	std::vector<std::pair<const Tree::Node*, int>> stack{ { tree.GetRoot(), 0 } };
+	while (!stack.empty())
+	{
+		const Tree::Node* node = stack.back().first;
+		const int depth = stack.back().second;
+		stack.pop_back();
+
+		points += node->points.size();
+		if (!node->IsLeaf())
+		{
+			EXPECT_TRUE(node->points.empty());
+			EXPECT_EQ(0u, node->points.capacity());
+			for (size_t i = 0; i < 8; i++)
+			{
+				if (nullptr != node->GetChild(i))
+					stack.push_back(std::make_pair(node->GetChild(i), depth + 1));
+			}
+		}
+		else if (6 == depth)
+			deepest = std::max(deepest, node->points.size());
+		else
+			EXPECT_LE(node->points.size(), tree.GetBucketSize());
+	}
+	EXPECT_EQ(tree.GetCount(), points);
+	EXPECT_GE(deepest, 20u);
+
+	size_t found = 0;
+	tree.Query(AABB(pile, 0.001f), [&found](const OctreePoint<void>&) { found++; });
+	EXPECT_EQ(20u, found);
+}
+
+TEST(VoxelOctree, SetGetCountAndRaycast)
+{
+	VoxelOctree<3> voxels(vec3{ 0.0f, 0.0f, 0.0f }, 1.0f);
+
+	for (int z = 10; z < 20; z++)
+		for (int y = 10; y < 20; y++)
+			for (int x = 10; x < 20; x++)
+				voxels.Set(ivec3{ x, y, z }, true);
+
+	EXPECT_EQ(1000u, voxels.GetCount());
+	EXPECT_TRUE(voxels.Get(ivec3{ 15, 15, 15 }));
+	EXPECT_FALSE(voxels.Get(ivec3{ 9, 15, 15 }));
+	EXPECT_EQ(125u, voxels.Count(ivec3{ 15, 15, 15 }, ivec3{ 30, 30, 30 }));
+	EXPECT_TRUE(voxels.IsEmpty(ivec3{ 0, 0, 0 }, ivec3{ 9, 63, 63 }));
+
+	ivec3 hit;
+	float t = 0.0f;
+	ASSERT_TRUE(voxels.Raycast(vec3{ 0.5f, 15.5f, 15.5f }, vec3{ 1.0f, 0.0f, 0.0f }, 100.0f, hit, t));
+	EXPECT_EQ(10, hit.x);
+	EXPECT_NEAR(9.5f, t, 1e-4f);
+
+	voxels.Set(ivec3{ 15, 15, 15 }, false);
+	EXPECT_EQ(999u, voxels.GetCount());
+	EXPECT_FALSE(voxels.Get(ivec3{ 15, 15, 15 }));
+}
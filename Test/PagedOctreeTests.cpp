@@ -0,0 +1,233 @@
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "PagedOctree.h"
+
+namespace
+{
+	struct Obj
+	{
+		uint32_t	id;
+		AABB		aabb;
+		const AABB& GetAABB() const { return aabb; }
+	};
+
+	typedef PagedOctree<Obj, 6, 2> Tree;
+
+	constexpr float world_half_size = 64.0f;
+	constexpr size_t budget = 16 * 1024;
+
+	// an empty directory of its own for every test, removed with everything left in it
+	struct TempDirectory
+	{
+		std::filesystem::path	path;
+
+		explicit TempDirectory(const char* name)
+			: path(std::filesystem::temp_directory_path() / name)
+		{
+			std::filesystem::remove_all(path);
+			std::filesystem::create_directories(path);
+		}
+
+		~TempDirectory() { std::filesystem::remove_all(path); }
+
+		uintmax_t GetBytes() const
+		{
+			uintmax_t bytes = 0;
+			for (auto& entry : std::filesystem::directory_iterator(path))
+				bytes += entry.file_size();
+			return bytes;
+		}
+	};
+
+	std::vector<Obj> random_objects(size_t count, unsigned seed)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> pos(-world_half_size + 2.0f, world_half_size - 2.0f);
+		std::uniform_real_distribution<float> size(0.05f, 1.5f);
+
+		std::vector<Obj> objects(count);
+		for (size_t i = 0; i < count; i++)
+			objects[i] = Obj{ static_cast<uint32_t>(i), AABB(vec3{ pos(rng), pos(rng), pos(rng) }, size(rng)) };
+		return objects;
+	}
+
+	std::set<uint32_t> query(Tree& tree, const AABB& box)
+	{
+		std::set<uint32_t> result;
+		tree.Query(box, [&result](Obj* o) { EXPECT_TRUE(result.insert(o->id).second) << "object reported twice"; });
+		return result;
+	}
+
+	std::set<uint32_t> brute_force(const std::vector<Obj>& objects, const AABB& box)
+	{
+		std::set<uint32_t> result;
+		for (auto& o : objects)
+		{
+			if (o.aabb.Intersects(box))
+				result.insert(o.id);
+		}
+		return result;
+	}
+
+	// objects kept in the nodes above the pages, which never reach a chunk file
+	size_t in_memory_objects(const Tree::Node* node)
+	{
+		size_t count = node->objects.size();
+		for (auto child : node->children)
+		{
+			if (nullptr != child)
+				count += in_memory_objects(child);
+		}
+		return count;
+	}
+
+	// the page in use may push the resident size past the budget, nothing else may
+	void expect_within_budget(const Tree& tree)
+	{
+		EXPECT_TRUE(tree.GetResidentBytes() <= tree.GetBudget() || 1 == tree.GetResidentPageCount());
+	}
+}
+
+TEST(PagedOctree, QueryMatchesBruteForceWithinBudget)
+{
+	TempDirectory directory("octree_paged_query");
+	auto objects = random_objects(4000, 11);
+
+	Tree tree(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size, directory.path.string(), budget);
+
+	// half one by one, half as a batch
+	const size_t half = objects.size() / 2;
+	for (size_t i = 0; i < half; i++)
+		ASSERT_TRUE(tree.Insert(objects[i]));
+	EXPECT_EQ(objects.size() - half, tree.Insert(objects.data() + half, objects.size() - half));
+	ASSERT_TRUE(tree);
+	expect_within_budget(tree);
+
+	Obj outside{ 0, AABB(vec3{ 0.0f, 0.0f, 2.0f * world_half_size }, 1.0f) };
+	EXPECT_FALSE(tree.Insert(outside));
+	EXPECT_EQ(0u, tree.Insert(&outside, 1));
+
+	std::mt19937 rng(3);
+	std::uniform_real_distribution<float> pos(-world_half_size, world_half_size);
+	std::uniform_real_distribution<float> size(1.0f, 24.0f);
+	for (int i = 0; i < 100; i++)
+	{
+		AABB box(vec3{ pos(rng), pos(rng), pos(rng) }, size(rng));
+		ASSERT_EQ(brute_force(objects, box), query(tree, box));
+		expect_within_budget(tree);
+	}
+
+	// the whole world cannot be resident at once, so pages were evicted on the way
+	AABB all(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size);
+	EXPECT_EQ(objects.size(), query(tree, all).size());
+	EXPECT_LT(tree.GetResidentPageCount(), tree.GetPageCount());
+	EXPECT_GT(tree.GetResidentBytes(), 0u);
+	expect_within_budget(tree);
+	EXPECT_TRUE(tree);
+}
+
+TEST(PagedOctree, DirtyPagesAreWrittenBack)
+{
+	TempDirectory directory("octree_paged_flush");
+	auto objects = random_objects(2000, 12);
+	auto more = random_objects(500, 13);
+	for (auto& o : more)
+		o.id += static_cast<uint32_t>(objects.size());
+
+	Tree tree(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size, directory.path.string(), budget);
+	EXPECT_EQ(objects.size(), tree.Insert(objects.data(), objects.size()));
+
+	// nothing is resident yet, the batch went straight to the chunk files
+	EXPECT_EQ(0u, tree.GetResidentPageCount());
+	EXPECT_EQ(0u, tree.GetResidentBytes());
+	EXPECT_EQ((objects.size() - in_memory_objects(tree.GetRoot())) * sizeof(Obj), directory.GetBytes());
+
+	// with every page resident, new objects only change memory until Flush()
+	AABB all(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size);
+	tree.SetBudget(static_cast<size_t>(-1));
+	query(tree, all);
+	EXPECT_EQ(tree.GetPageCount(), tree.GetResidentPageCount());
+	for (auto& o : more)
+		ASSERT_TRUE(tree.Insert(o));
+
+	const uintmax_t before = directory.GetBytes();
+	ASSERT_TRUE(tree.Flush());
+	objects.insert(objects.end(), more.begin(), more.end());
+	EXPECT_LT(before, directory.GetBytes());
+	EXPECT_EQ((objects.size() - in_memory_objects(tree.GetRoot())) * sizeof(Obj), directory.GetBytes());
+
+	// dropping everything and paging it back in loses nothing
+	tree.SetBudget(0);
+	EXPECT_EQ(0u, tree.GetResidentPageCount());
+	EXPECT_EQ(0u, tree.GetResidentBytes());
+
+	tree.SetBudget(budget);
+	EXPECT_EQ(brute_force(objects, all), query(tree, all));
+	EXPECT_TRUE(tree);
+}
+
+TEST(PagedOctree, IgnoresChunksOfEarlierRuns)
+{
+	TempDirectory directory("octree_paged_stale");
+
+	// a file for each of the 64 pages the tree can make, full of objects that must never come
+	// back, and one for a page it never makes
+	std::vector<Obj> stale(16, Obj{ 7, AABB(vec3{ 1.0f, 1.0f, 1.0f }, 0.5f) });
+	auto write_stale = [&](int id)
+	{
+		const std::filesystem::path path = directory.path / ("chunk_" + std::to_string(id) + ".bin");
+		std::FILE* file = std::fopen(path.string().c_str(), "wb");
+		ASSERT_NE(nullptr, file);
+		std::fwrite(stale.data(), sizeof(Obj), stale.size(), file);
+		std::fclose(file);
+	};
+	for (int id = 0; id < 64; id++)
+		write_stale(id);
+	write_stale(1000);
+
+	AABB all(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size);
+	{
+		Tree tree(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size, directory.path.string(), budget);
+
+		Obj fresh{ 9999, AABB(vec3{ 1.0f, 1.0f, 1.0f }, 0.5f) };
+		ASSERT_TRUE(tree.Insert(fresh));
+		EXPECT_EQ(std::set<uint32_t>{ 9999 }, query(tree, all));
+
+		auto objects = random_objects(500, 15);
+		EXPECT_EQ(objects.size(), tree.Insert(objects.data(), objects.size()));
+		objects.push_back(fresh);
+
+		tree.SetBudget(0);
+		EXPECT_EQ(brute_force(objects, all), query(tree, all));
+		EXPECT_TRUE(tree);
+	}
+
+	// files the tree never wrote are left alone
+	EXPECT_TRUE(std::filesystem::exists(directory.path / "chunk_1000.bin"));
+}
+
+TEST(PagedOctree, MissingChunkFails)
+{
+	TempDirectory directory("octree_paged_missing");
+	auto objects = random_objects(1000, 14);
+
+	Tree tree(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size, directory.path.string(), budget);
+	EXPECT_EQ(objects.size(), tree.Insert(objects.data(), objects.size()));
+	ASSERT_TRUE(tree);
+
+	for (auto& entry : std::filesystem::directory_iterator(directory.path))
+		std::filesystem::remove(entry.path());
+
+	// only the objects above the pages are left to report
+	AABB all(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size);
+	EXPECT_EQ(in_memory_objects(tree.GetRoot()), query(tree, all).size());
+	EXPECT_FALSE(tree);
+	EXPECT_EQ(0u, tree.GetResidentPageCount());
+}
@@ -0,0 +1,245 @@
+#include <random>
+#include <set>
+#include <tuple>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "OctreeReplica.h"
+
+namespace
+{
+	struct Obj
+	{
+		uint64_t	id;
+		AABB		aabb;
+		const AABB& GetAABB() const { return aabb; }
+		uint64_t GetID() const { return id; }
+	};
+
+	typedef Octree<Obj, 5> Leader;
+	typedef OctreeReplica<float, 5> Follower;
+	typedef std::tuple<float, float, float, float> BoundKey;
+
+	constexpr float world_half_size = 64.0f;
+
+	AABB random_box(std::mt19937& rng)
+	{
+		std::uniform_real_distribution<float> pos(-world_half_size + 2.0f, world_half_size - 2.0f);
+		std::uniform_real_distribution<float> size(0.05f, 2.0f);
+		return AABB(vec3{ pos(rng), pos(rng), pos(rng) }, size(rng));
+	}
+
+	BoundKey key(const NodeBoundingBox& b) { return BoundKey(b.center.x, b.center.y, b.center.z, b.halfSize); }
+
+	template<typename Tree>
+	std::set<BoundKey> node_bounds(const Tree& tree)
+	{
+		std::set<BoundKey> bounds;
+		for (auto n : tree.Nodes())
+			bounds.insert(key(n->bound));
+		return bounds;
+	}
+
+	// serialises delta, passes it through the transport and applies what arrives
+	bool ship(const OctreeDelta& delta, OctreeLoopbackTransport& transport, Follower& follower)
+	{
+		std::vector<uint8_t> message;
+		OctreeWriteDelta(delta, message);
+		transport.Send(message);
+
+		std::vector<uint8_t> received;
+		OctreeDelta decoded;
+		EXPECT_TRUE(transport.Receive(received));
+		EXPECT_TRUE(OctreeReadDelta(received.data(), received.size(), decoded));
+		EXPECT_EQ(delta.added.size(), decoded.added.size());
+		EXPECT_EQ(delta.removed.size(), decoded.removed.size());
+		EXPECT_EQ(delta.prunedNodes.size(), decoded.prunedNodes.size());
+		return follower.Apply(decoded);
+	}
+
+	void expect_same(const std::vector<Obj>& objects, const std::vector<bool>& live, const Leader& leader, const Follower& follower)
+	{
+		size_t count = 0;
+		for (size_t i = 0; i < objects.size(); i++)
+		{
+			auto o = follower.Find(objects[i].id);
+			if (!live[i])
+			{
+				EXPECT_EQ(nullptr, o);
+				continue;
+			}
+
+			count++;
+			ASSERT_NE(nullptr, o);
+			EXPECT_EQ(objects[i].aabb.min.x, o->box.min.x);
+			EXPECT_EQ(objects[i].aabb.max.z, o->box.max.z);
+		}
+		EXPECT_EQ(count, follower.GetCount());
+		EXPECT_EQ(node_bounds(leader), node_bounds(follower.GetTree()));
+		EXPECT_TRUE(follower.GetTree().Validate());
+	}
+}
+
+TEST(OctreeReplica, FollowsDeltas)
+{
+	OctreeConfig config;
+	config.history = true;
+
+	Leader leader(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size, config);
+	Follower follower(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size, config);
+	OctreeLoopbackTransport transport;
+
+	std::mt19937 rng(31);
+	std::vector<Obj> objects(1000);
+	std::vector<bool> live(objects.size(), false);
+	for (size_t i = 0; i < objects.size(); i++)
+		objects[i] = Obj{ 1000 + i, random_box(rng) };
+
+	for (size_t i = 0; i < 600; i++)
+	{
+		leader.Insert(&objects[i]);
+		live[i] = true;
+	}
+
+	OctreeDelta delta;
+	leader.DiffSince(follower.GetVersion(), delta);
+	EXPECT_FALSE(delta.reset);
+	EXPECT_EQ(600u, delta.added.size());
+	ASSERT_TRUE(ship(delta, transport, follower));
+	expect_same(objects, live, leader, follower);
+
+	for (int round = 0; round < 20; round++)
+	{
+		const std::set<BoundKey> before = node_bounds(leader);
+
+		// a few removes, moves and inserts, each object touched at most once per round
+		std::set<size_t> touched;
+		size_t changes = 0;
+		for (int i = 0; i < 30; i++)
+		{
+			size_t idx = rng() % objects.size();
+			if (!touched.insert(idx).second)
+				continue;
+
+			Obj& o = objects[idx];
+			changes++;
+			if (!live[idx])
+			{
+				leader.Insert(&o);
+				live[idx] = true;
+			}
+			else if (rng() % 2)
+			{
+				ASSERT_TRUE(leader.Remove(&o));
+				live[idx] = false;
+			}
+			else
+			{
+				ASSERT_TRUE(leader.Remove(&o));
+				o.aabb = random_box(rng);
+				leader.Insert(&o);
+			}
+		}
+
+		leader.DiffSince(follower.GetVersion(), delta);
+		EXPECT_FALSE(delta.reset);
+		EXPECT_EQ(leader.GetVersion(), delta.version);
+		EXPECT_EQ(changes, delta.added.size() + delta.moved.size() + delta.removed.size());
+
+		// created nodes are live, and the node set changes are all reported
+		const std::set<BoundKey> after = node_bounds(leader);
+		std::set<BoundKey> created, pruned;
+		for (auto& b : delta.createdNodes)
+			created.insert(key(b));
+		for (auto& b : delta.prunedNodes)
+			pruned.insert(key(b));
+		for (auto& b : created)
+			EXPECT_TRUE(after.count(b));
+		for (auto& b : after)
+			EXPECT_TRUE(before.count(b) || created.count(b));
+		for (auto& b : before)
+			EXPECT_TRUE(after.count(b) || pruned.count(b));
+
+		ASSERT_TRUE(ship(delta, transport, follower));
+		expect_same(objects, live, leader, follower);
+	}
+
+	// a delta that does not start at the follower version is refused
+	const uint64_t synced = follower.GetVersion();
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		if (!live[i])
+		{
+			leader.Insert(&objects[i]);
+			live[i] = true;
+			break;
+		}
+	}
+	leader.DiffSince(synced - 1, delta);
+	EXPECT_FALSE(follower.Apply(delta));
+	EXPECT_EQ(synced, follower.GetVersion());
+
+	// once the history is trimmed past the follower, it gets a reset snapshot
+	leader.TrimHistory(leader.GetVersion());
+	leader.DiffSince(follower.GetVersion(), delta);
+	EXPECT_TRUE(delta.reset);
+	EXPECT_TRUE(delta.removed.empty());
+}
+
+TEST(OctreeReplica, WithoutHistoryEveryChangeResets)
+{
+	Leader leader(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size);
+
+	std::mt19937 rng(5);
+	std::vector<Obj> objects(100);
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		objects[i] = Obj{ i, random_box(rng) };
+		leader.Insert(&objects[i]);
+	}
+
+	OctreeDelta delta;
+	leader.DiffSince(leader.GetVersion(), delta);
+	EXPECT_FALSE(delta.reset);
+	EXPECT_TRUE(delta.added.empty());
+	EXPECT_TRUE(delta.createdNodes.empty());
+
+	const uint64_t version = leader.GetVersion();
+	leader.Remove(&objects[3]);
+	leader.DiffSince(version, delta);
+	EXPECT_TRUE(delta.reset);
+	EXPECT_EQ(99u, delta.added.size());
+
+	Follower follower(vec3{ 0.0f, 0.0f, 0.0f }, world_half_size);
+	ASSERT_TRUE(follower.Apply(delta));
+	EXPECT_EQ(99u, follower.GetCount());
+	EXPECT_EQ(nullptr, follower.Find(3));
+	EXPECT_EQ(node_bounds(leader), node_bounds(follower.GetTree()));
+}
+
+TEST(OctreeReplica, RejectsBrokenMessages)
+{
+	OctreeDelta delta;
+	delta.version = 7;
+	delta.added.push_back(OctreeDelta::Object{ 1, AABB(vec3{ 0.0f, 0.0f, 0.0f }, 1.0f) });
+	delta.removed.push_back(2);
+
+	std::vector<uint8_t> message;
+	OctreeWriteDelta(delta, message);
+
+	OctreeDelta decoded;
+	ASSERT_TRUE(OctreeReadDelta(message.data(), message.size(), decoded));
+	EXPECT_EQ(7u, decoded.version);
+	ASSERT_EQ(1u, decoded.added.size());
+	EXPECT_EQ(1u, decoded.added[0].id);
+	EXPECT_EQ(1.0f, decoded.added[0].box.max.x);
+
+	EXPECT_FALSE(OctreeReadDelta(message.data(), message.size() - 1, decoded));
+
+	dOctreeDelta wide;
+	EXPECT_FALSE(OctreeReadDelta(message.data(), message.size(), wide));
+
+	message[0] ^= 0xff;
+	EXPECT_FALSE(OctreeReadDelta(message.data(), message.size(), decoded));
+}
@@ -1,3 +1,4 @@
+#include <cstdlib>
 #include <iostream>
 #include <iomanip>
 #include <string>
@@ -31,34 +32,38 @@ void output_data(const OctreeData<Obj>* data)
 	cout << ']';
 }
 
-void output_octree(const OctreeNode<Obj>* node, string indent)
+// one line per node in depth first order, the children of a node indented inside braces
+void output_octree(const Octree<Obj, 3>& octree)
 {
-	if (nullptr == node)
-		return;
-
-	if (node->IsLeaf())
-	{
-		output_data(node->objects);
-	}
-	else
+	int open = 0;
+	for (Octree<Obj, 3>::NodeIterator it(octree.GetRoot()); !it.IsEnd(); ++it)
 	{
-		cout << endl << indent << '{' << endl;
+		const OctreeNode<Obj>* node = *it;
+		const int depth = it.GetDepth();
+
+		for (; open > depth; open--)
+			cout << string(4 * (open - 1), ' ') << '}' << endl;
 
+		cout << string(4 * depth, ' ');
+		if (nullptr != node->parent)
+			cout << static_cast<int>(node->index) << ' ';
+		output_aabb(AABB(node->bound));
 		if (nullptr != node->objects)
 		{
-			cout << indent << "    "; output_data(node->objects);  cout << endl;
+			cout << ' ';
+			output_data(node->objects);
 		}
+		cout << endl;
 
-		for (size_t i = 0; i < 8; i++)
+		if (!node->IsLeaf())
 		{
-			cout << indent << "    " << i << ' ';
-			output_aabb(node->GetChildBound(i));
-			output_octree(node->GetChild(i), indent + "    ");
-			cout << endl;
+			cout << string(4 * depth, ' ') << '{' << endl;
+			open = depth + 1;
 		}
-
-		cout << indent << '}';
 	}
+
+	for (; open > 0; open--)
+		cout << string(4 * (open - 1), ' ') << '}' << endl;
 }
 
 int main()
@@ -73,11 +78,11 @@ int main()
 	octree.Insert(&obj);
 	octree.Insert(&obj2);
 
-	auto r = octree.GetRoot();
-
-	output_octree(r, "");
+	output_octree(octree);
 
+#ifdef _WIN32
 	system("Pause");
+#endif
 
 	return 0;
 }
@@ -7,19 +7,26 @@
 #pragma push_macro("min")
 #undef min
 
-struct AABB
+template<typename S>
+struct TAABB
 {
-	vec3	min;
-	vec3	max;
+	typedef S scalar_type;
+	typedef Vector3<S> vec_type;
 
-	inline AABB() : min(vec3()), max(vec3()) {}
-	inline AABB(const vec3& min, const vec3& max) : min(min), max(max) {}
-	inline AABB(const vec3& center, float halfSize)
+	vec_type	min;
+	vec_type	max;
+
+	inline TAABB() : min(vec_type()), max(vec_type()) {}
+	inline TAABB(const vec_type& min, const vec_type& max) : min(min), max(max) {}
+	inline TAABB(const vec_type& center, S halfSize)
 		:
-		min(vec3{ center.x - halfSize, center.y - halfSize , center.z - halfSize }),
-		max(vec3{ center.x + halfSize, center.y + halfSize , center.z + halfSize }) {}
+		min(vec_type{ center.x - halfSize, center.y - halfSize , center.z - halfSize }),
+		max(vec_type{ center.x + halfSize, center.y + halfSize , center.z + halfSize }) {}
+
+	template<typename N>
+	inline explicit operator TAABB<N>() const { return TAABB<N>(static_cast<Vector3<N>>(min), static_cast<Vector3<N>>(max)); }
 
-	inline bool Contains(const vec3& point) const
+	inline bool Contains(const vec_type& point) const
 	{
 		return
 			min.x <= point.x && point.x <= max.x &&
@@ -27,14 +34,114 @@ struct AABB
 			min.z <= point.z && point.z <= max.z;
 	}
 
-	inline bool Contains(const AABB& other) const
+	inline bool Contains(const TAABB& other) const
 	{
 		return
 			min.x <= other.min.x && other.max.x <= max.x &&
 			min.y <= other.min.y && other.max.y <= max.y &&
-			min.x <= other.min.z && other.max.z <= max.z;
+			min.z <= other.min.z && other.max.z <= max.z;
+	}
+
+	inline bool Intersects(const TAABB& other) const
+	{
+		return
+			min.x <= other.max.x && other.min.x <= max.x &&
+			min.y <= other.max.y && other.min.y <= max.y &&
+			min.z <= other.max.z && other.min.z <= max.z;
+	}
+
+	// Slab test of this box moving by delta over t in [0, 1] against the static box other,
+	// giving the interval during which they overlap. An axis without motion only checks the
+	// overlap on that axis, so no division by zero happens.
+	inline bool Sweep(const vec_type& delta, const TAABB& other, S& tEnter, S& tExit) const
+	{
+		const S lo[3] = { min.x, min.y, min.z };
+		const S hi[3] = { max.x, max.y, max.z };
+		const S olo[3] = { other.min.x, other.min.y, other.min.z };
+		const S ohi[3] = { other.max.x, other.max.y, other.max.z };
+		const S d[3] = { delta.x, delta.y, delta.z };
+
+		S t0 = S(0), t1 = S(1);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (S(0) == d[axis])
+			{
+				if (hi[axis] < olo[axis] || ohi[axis] < lo[axis])
+					return false;
+				continue;
+			}
+
+			// touching starts when the leading face reaches the near face of other
+			// and ends when the trailing face leaves its far face
+			const S inv = S(1) / d[axis];
+			S ta = (olo[axis] - hi[axis]) * inv;
+			S tb = (ohi[axis] - lo[axis]) * inv;
+			if (ta > tb)
+			{
+				S tmp = ta; ta = tb; tb = tmp;
+			}
+			if (ta > t0)
+				t0 = ta;
+			if (tb < t1)
+				t1 = tb;
+			if (t0 > t1)
+				return false;
+		}
+
+		tEnter = t0;
+		tExit = t1;
+		return true;
+	}
+
+	// smallest box enclosing both, an inverted box acts as the empty set
+	inline TAABB Union(const TAABB& other) const
+	{
+		return TAABB(
+			vec_type{ min.x < other.min.x ? min.x : other.min.x, min.y < other.min.y ? min.y : other.min.y, min.z < other.min.z ? min.z : other.min.z },
+			vec_type{ max.x > other.max.x ? max.x : other.max.x, max.y > other.max.y ? max.y : other.max.y, max.z > other.max.z ? max.z : other.max.z });
+	}
+
+	// box relative to origin in single precision, for local frames of large worlds
+	inline TAABB<float> Relative(const vec_type& origin) const
+	{
+		return TAABB<float>(static_cast<Vector3<float>>(min - origin), static_cast<Vector3<float>>(max - origin));
 	}
 };
 
+#if defined(OCTREE_SIMD_SSE) || defined(OCTREE_SIMD_NEON)
+// the tests of the hot paths on whole registers, the w lanes drop out of the comparisons
+template<>
+inline TAABB<float>::TAABB(const Vector3<float>& center, float halfSize)
+{
+	const OctreeSimd::Register c = OctreeSimd::Load(center), h = OctreeSimd::Splat(halfSize);
+	min = OctreeSimd::Store(OctreeSimd::Sub(c, h));
+	max = OctreeSimd::Store(OctreeSimd::Add(c, h));
+}
+
+template<>
+inline bool TAABB<float>::Contains(const TAABB<float>& other) const
+{
+	using namespace OctreeSimd;
+	return AllLessEqual(Load(min), Load(other.min), Load(other.max), Load(max));
+}
+
+template<>
+inline bool TAABB<float>::Intersects(const TAABB<float>& other) const
+{
+	using namespace OctreeSimd;
+	return AllLessEqual(Load(min), Load(other.max), Load(other.min), Load(max));
+}
+
+template<>
+inline TAABB<float> TAABB<float>::Union(const TAABB<float>& other) const
+{
+	using namespace OctreeSimd;
+	return TAABB<float>(Store(Min(Load(min), Load(other.min))), Store(Max(Load(max), Load(other.max))));
+}
+#endif
+
+typedef TAABB<float>	AABB;
+typedef TAABB<double>	dAABB;
+
 #pragma pop_macro("min")
 #pragma pop_macro("max")
@@ -0,0 +1,140 @@
+#include "DebugDraw.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+	// corner i has bit 0 set for max x, bit 1 for max y and bit 2 for max z
+	const DebugDrawList::Vertex unit_box_vertices[DebugDrawList::unit_box_vertex_count] = {
+		{ -1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f },
+		{ 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f },
+		{ -1.0f, 1.0f, -1.0f, 1.0f, 1.0f, 1.0f },
+		{ 1.0f, 1.0f, -1.0f, 1.0f, 1.0f, 1.0f },
+		{ -1.0f, -1.0f, 1.0f, 1.0f, 1.0f, 1.0f },
+		{ 1.0f, -1.0f, 1.0f, 1.0f, 1.0f, 1.0f },
+		{ -1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f },
+		{ 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f },
+	};
+
+	const uint16_t unit_box_indices[DebugDrawList::unit_box_index_count] = {
+		0, 1,	2, 3,	4, 5,	6, 7,		// along x
+		0, 2,	1, 3,	4, 6,	5, 7,		// along y
+		0, 4,	1, 5,	2, 6,	3, 7,		// along z
+	};
+
+	constexpr size_t max_16bit_vertices = size_t(std::numeric_limits<uint16_t>::max()) + 1;
+}
+
+DebugDrawList::DebugDrawList(bool instancedBoxes)
+	:
+	mInstanced(instancedBoxes),
+	mWideIndices(false)
+{
+
+}
+
+void DebugDrawList::AddLine(const vec3& start, const vec3& end, const vec3& col)
+{
+	WidenIndices(2);
+
+	uint32_t idx = static_cast<uint32_t>(mVertices.size());
+
+	mVertices.push_back(Vertex{ start.x, start.y, start.z, col.x, col.y, col.z });
+	mVertices.push_back(Vertex{ end.x, end.y, end.z, col.x, col.y, col.z });
+
+	AddIndex(idx);
+	AddIndex(idx + 1);
+}
+
+void DebugDrawList::AddBox(const AABB& box, const vec3& col)
+{
+	if (mInstanced)
+	{
+		vec3 c = (box.min + box.max) * 0.5f;
+		vec3 h = (box.max - box.min) * 0.5f;
+		mInstances.push_back(BoxInstance{ { c.x, c.y, c.z }, { h.x, h.y, h.z }, PackColor(col) });
+		return;
+	}
+
+	WidenIndices(unit_box_vertex_count);
+
+	uint32_t idx = static_cast<uint32_t>(mVertices.size());
+
+	for (size_t i = 0; i < unit_box_vertex_count; i++)
+	{
+		mVertices.push_back(Vertex{
+			(i & 1) ? box.max.x : box.min.x,
+			(i & 2) ? box.max.y : box.min.y,
+			(i & 4) ? box.max.z : box.min.z,
+			col.x, col.y, col.z });
+	}
+
+	for (size_t i = 0; i < unit_box_index_count; i++)
+		AddIndex(idx + unit_box_indices[i]);
+}
+
+void DebugDrawList::Clear()
+{
+	mVertices.clear();
+	mIndices16.clear();
+	mIndices32.clear();
+	mInstances.clear();
+	mWideIndices = false;
+}
+
+const void* DebugDrawList::GetIndexData() const
+{
+	if (mWideIndices)
+		return mIndices32.data();
+	else
+		return mIndices16.data();
+}
+
+size_t DebugDrawList::GetByteSize() const
+{
+	return
+		mVertices.size() * sizeof(Vertex) +
+		GetIndexCount() * GetIndexSize() +
+		mInstances.size() * sizeof(BoxInstance);
+}
+
+const DebugDrawList::Vertex* DebugDrawList::GetUnitBoxVertices()
+{
+	return unit_box_vertices;
+}
+
+const uint16_t* DebugDrawList::GetUnitBoxIndices()
+{
+	return unit_box_indices;
+}
+
+uint32_t DebugDrawList::PackColor(const vec3& col)
+{
+	auto channel = [](float v)
+	{
+		v = std::min(std::max(v, 0.0f), 1.0f);
+		return static_cast<uint32_t>(v * 255.0f + 0.5f);
+	};
+
+	return channel(col.x) | channel(col.y) << 8 | channel(col.z) << 16 | 0xff000000u;
+}
+
+void DebugDrawList::WidenIndices(size_t vertices)
+{
+	// once the vertices no longer fit 16 bit indices, widen the ones written so far
+	if (!mWideIndices && mVertices.size() + vertices > max_16bit_vertices)
+	{
+		mIndices32.assign(mIndices16.begin(), mIndices16.end());
+		mIndices16.clear();
+		mWideIndices = true;
+	}
+}
+
+void DebugDrawList::AddIndex(uint32_t idx)
+{
+	if (mWideIndices)
+		mIndices32.push_back(idx);
+	else
+		mIndices16.push_back(static_cast<uint16_t>(idx));
+}
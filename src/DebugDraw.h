@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Vector3.h"
+#include "AABB.h"
+
+// CPU side batch of debug lines, independent of any graphics API.
+// Vertices and line list indices grow as needed; indices are 16 bit until the vertex count
+// no longer fits and switch to 32 bit from then on, until the next Clear().
+// In instanced mode AddBox() stores one compact instance per box instead, to be drawn with
+// the shared unit cube from GetUnitBoxVertices() and GetUnitBoxIndices().
+class DebugDrawList
+{
+public:
+
+	// matches the POSITION, COLOR input layout of the renderer
+	struct Vertex
+	{
+		float	x, y, z;
+		float	r, g, b;
+	};
+
+	// box as a scale and translation of the unit cube [-1, 1]^3, colour packed as RGBA8
+	struct BoxInstance
+	{
+		float		center[3];
+		float		halfSize[3];
+		uint32_t	color;
+	};
+
+	explicit DebugDrawList(bool instancedBoxes = false);
+
+	void AddLine(const vec3& start, const vec3& end, const vec3& col);
+	void AddBox(const AABB& box, const vec3& col);
+
+	// empties the batch, keeping the storage, and goes back to 16 bit indices
+	void Clear();
+
+	inline bool IsInstanced() const { return mInstanced; }
+	inline bool Uses32BitIndices() const { return mWideIndices; }
+
+	inline const std::vector<Vertex>& GetVertices() const { return mVertices; }
+	inline size_t GetVertexCount() const { return mVertices.size(); }
+
+	inline size_t GetIndexCount() const { return mWideIndices ? mIndices32.size() : mIndices16.size(); }
+	inline size_t GetIndexSize() const { return mWideIndices ? sizeof(uint32_t) : sizeof(uint16_t); }
+	const void* GetIndexData() const;
+
+	inline const std::vector<BoxInstance>& GetInstances() const { return mInstances; }
+
+	// bytes the current contents take in vertex, index and instance buffers
+	size_t GetByteSize() const;
+
+	static const Vertex* GetUnitBoxVertices();		// 8 corners, white
+	static const uint16_t* GetUnitBoxIndices();		// 24 indices, 12 lines
+
+	static constexpr size_t unit_box_vertex_count = 8;
+	static constexpr size_t unit_box_index_count = 24;
+
+	static uint32_t PackColor(const vec3& col);
+
+private:
+	void WidenIndices(size_t vertices);
+	void AddIndex(uint32_t idx);
+
+	bool						mInstanced;
+	bool						mWideIndices;
+
+	std::vector<Vertex>			mVertices;
+	std::vector<uint16_t>		mIndices16;
+	std::vector<uint32_t>		mIndices32;
+	std::vector<BoxInstance>	mInstances;
+};
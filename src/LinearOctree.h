@@ -0,0 +1,283 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "Octree.h"
+
+// spreads the low 21 bits of v so two zero bits follow each one
+inline uint64_t OctreeMortonSpread(uint64_t v)
+{
+	v &= 0x1fffff;
+	v = (v | v << 32) & 0x001f00000000ffffull;
+	v = (v | v << 16) & 0x001f0000ff0000ffull;
+	v = (v | v << 8) & 0x100f00f00f00f00full;
+	v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+	v = (v | v << 2) & 0x1249249249249249ull;
+	return v;
+}
+
+// Morton code of a cell, x in the lowest bit like the OctreeNode child index
+inline uint64_t OctreeMortonCode(const ivec3& cell)
+{
+	return
+		OctreeMortonSpread(static_cast<uint64_t>(cell.x)) |
+		OctreeMortonSpread(static_cast<uint64_t>(cell.y)) << 1 |
+		OctreeMortonSpread(static_cast<uint64_t>(cell.z)) << 2;
+}
+
+// Pointerless octree keeping a compact proxy (object, AABB, node code) per object in one
+// array sorted by the Morton code of the node the object belongs to, so every subtree is a
+// contiguous run and full passes or large range queries scan memory sequentially.
+// Objects are classified on the integer grid of 2^MAX_DEPTH cells per axis like a quantised
+// Octree. Inserts go to an unsorted tail and removes leave tombstones until Compact(), which
+// runs by itself once they make up a quarter of the array.
+template<typename T, int MAX_DEPTH>
+class LinearOctree
+{
+	static_assert(0 <= MAX_DEPTH && MAX_DEPTH <= OCTREE_MAX_DYNAMIC_DEPTH, "Morton codes hold at most 21 levels");
+
+public:
+
+	typedef typename OctreeTraits<T>::scalar_type Scalar;
+	typedef typename OctreeTraits<T>::vec_type Vec;
+	typedef typename OctreeTraits<T>::aabb_type Box;
+
+	struct Proxy
+	{
+		Box			box;
+		uint64_t	code;		// Morton code of the node cell, scaled to MAX_DEPTH
+		T*			object;		// nullptr once removed
+		int			depth;
+	};
+
+	inline LinearOctree(Vec center, Scalar halfSize)
+		: center(center), halfSize(halfSize), sorted(0), dead(0) { }
+
+	// returns false if object is not inside the root bound
+	inline bool Insert(T* object)
+	{
+		Box box = object->GetAABB();
+		if (!Box(center, halfSize).Contains(box))
+			return false;
+
+		Proxy proxy{ box, 0, object, 0 };
+		Classify(box, proxy.code, proxy.depth);
+		proxies.push_back(proxy);
+
+		CompactIfDirty();
+		return true;
+	}
+
+	// object must still report the AABB it was inserted with
+	inline bool Remove(T* object)
+	{
+		Proxy key{ object->GetAABB(), 0, object, 0 };
+		Classify(key.box, key.code, key.depth);
+
+		auto first = proxies.begin(), last = proxies.begin() + sorted;
+		auto range = std::equal_range(first, last, key, Before);
+		for (auto it = range.first; it != range.second; ++it)
+		{
+			if (it->object == object)
+			{
+				Kill(*it);
+				return true;
+			}
+		}
+
+		for (auto it = last; it != proxies.end(); ++it)
+		{
+			if (it->object == object)
+			{
+				Kill(*it);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// drops the tombstones and merges the unsorted tail into the Morton ordered run
+	inline void Compact()
+	{
+		size_t live = 0;
+		for (size_t i = 0; i < sorted; i++)
+			live += nullptr != proxies[i].object ? 1 : 0;
+
+		// remove_if keeps the order, so the sorted run stays sorted
+		proxies.erase(std::remove_if(proxies.begin(), proxies.end(), [](const Proxy& p) { return nullptr == p.object; }), proxies.end());
+		sorted = live;
+
+		std::sort(proxies.begin() + sorted, proxies.end(), Before);
+		std::inplace_merge(proxies.begin(), proxies.begin() + sorted, proxies.end(), Before);
+
+		sorted = proxies.size();
+		dead = 0;
+	}
+
+	inline void Clear()
+	{
+		proxies.clear();
+		sorted = 0;
+		dead = 0;
+	}
+
+	// calls func(T*) for every object whose AABB intersects box
+	template<typename F>
+	inline void Query(const Box& box, F&& func) const
+	{
+		struct Frame
+		{
+			uint64_t	code;
+			ivec3		cell;		// node cell on the grid of its own depth
+			int			depth;
+			size_t		begin;
+			size_t		end;
+		};
+
+		// every level pops one node and pushes at most eight
+		Frame stack[7 * MAX_DEPTH + 1];
+		int top = 0;
+		stack[top++] = Frame{ 0, ivec3{ 0, 0, 0 }, 0, 0, sorted };
+
+		while (top > 0)
+		{
+			const Frame frame = stack[--top];
+			if (frame.begin == frame.end)
+				continue;
+
+			const Box bound = LooseBound(frame.cell, frame.depth);
+			if (!bound.Intersects(box))
+				continue;
+
+			// the whole subtree lies inside box, every object in it is a hit
+			if (box.Contains(bound))
+			{
+				for (size_t i = frame.begin; i < frame.end; i++)
+				{
+					if (nullptr != proxies[i].object)
+						func(proxies[i].object);
+				}
+				continue;
+			}
+
+			// the objects of the node itself sort first, ahead of child 0 with the same code
+			size_t i = frame.begin;
+			for (; i < frame.end && proxies[i].depth == frame.depth; i++)
+			{
+				if (nullptr != proxies[i].object && proxies[i].box.Intersects(box))
+					func(proxies[i].object);
+			}
+
+			if (frame.depth == MAX_DEPTH)
+				continue;
+
+			const uint64_t span = uint64_t(1) << (3 * (MAX_DEPTH - frame.depth - 1));
+			for (size_t c = 8; c-- > 0;)
+			{
+				const uint64_t code = frame.code + c * span;
+				size_t begin = LowerBound(i, frame.end, code);
+				size_t end = LowerBound(begin, frame.end, code + span);
+				if (begin == end)
+					continue;
+
+				ivec3 cell{ frame.cell.x * 2 + int(c & 1), frame.cell.y * 2 + int(c >> 1 & 1), frame.cell.z * 2 + int(c >> 2 & 1) };
+				stack[top++] = Frame{ code, cell, frame.depth + 1, begin, end };
+			}
+		}
+
+		for (size_t i = sorted; i < proxies.size(); i++)
+		{
+			if (nullptr != proxies[i].object && proxies[i].box.Intersects(box))
+				func(proxies[i].object);
+		}
+	}
+
+	// calls func(T*) for every object, in Morton order up to the unsorted tail
+	template<typename F>
+	inline void ForEach(F&& func) const
+	{
+		for (auto& proxy : proxies)
+		{
+			if (nullptr != proxy.object)
+				func(proxy.object);
+		}
+	}
+
+	inline size_t GetCount() const { return proxies.size() - dead; }
+
+	inline bool IsCompact() const { return 0 == dead && sorted == proxies.size(); }
+
+	inline const std::vector<Proxy>& GetProxies() const { return proxies; }
+
+private:
+
+	// node order: by code, and the node before its descendants sharing that code
+	static inline bool Before(const Proxy& a, const Proxy& b)
+	{
+		return a.code < b.code || (a.code == b.code && a.depth < b.depth);
+	}
+
+	inline size_t LowerBound(size_t begin, size_t end, uint64_t code) const
+	{
+		auto it = std::lower_bound(proxies.begin() + begin, proxies.begin() + end, code,
+			[](const Proxy& p, uint64_t c) { return p.code < c; });
+		return static_cast<size_t>(it - proxies.begin());
+	}
+
+	inline void Kill(Proxy& proxy)
+	{
+		proxy.object = nullptr;
+		dead++;
+		CompactIfDirty();
+	}
+
+	inline void CompactIfDirty()
+	{
+		const size_t dirty = dead + proxies.size() - sorted;
+		if (dirty > 64 && dirty * 4 > proxies.size())
+			Compact();
+	}
+
+	// the deepest node whose cell holds both grid corners of box, as in a quantised Octree
+	inline void Classify(const Box& box, uint64_t& code, int& depth) const
+	{
+		const int cells = 1 << MAX_DEPTH;
+		const Scalar scale = static_cast<Scalar>(cells) / (halfSize * 2);
+		const Vec origin = center - Vec{ halfSize, halfSize, halfSize };
+
+		auto cell = [cells, scale](Scalar v, Scalar o)
+		{
+			Scalar f = (v - o) * scale;
+			return f <= 0 ? 0 : (f >= static_cast<Scalar>(cells) ? cells - 1 : static_cast<int>(f));
+		};
+
+		ivec3 gmin{ cell(box.min.x, origin.x), cell(box.min.y, origin.y), cell(box.min.z, origin.z) };
+		ivec3 gmax{ cell(box.max.x, origin.x), cell(box.max.y, origin.y), cell(box.max.z, origin.z) };
+
+		int diff = (gmin.x ^ gmax.x) | (gmin.y ^ gmax.y) | (gmin.z ^ gmax.z);
+		int shift = 0;
+		while (0 != (diff >> shift))
+			shift++;
+
+		depth = MAX_DEPTH - shift;
+		code = OctreeMortonCode(ivec3{ gmin.x >> shift, gmin.y >> shift, gmin.z >> shift }) << (3 * shift);
+	}
+
+	// bound of the node at cell and depth, padded by one grid cell to cover rounding at cell edges
+	inline Box LooseBound(const ivec3& cell, int depth) const
+	{
+		const Scalar size = halfSize * 2 / static_cast<Scalar>(1 << MAX_DEPTH);
+		const Scalar extent = halfSize * 2 / static_cast<Scalar>(1 << depth);
+		const Vec lo = center - Vec{ halfSize, halfSize, halfSize } + Vec{ cell.x * extent, cell.y * extent, cell.z * extent };
+		const Vec pad{ size, size, size };
+		return Box(lo - pad, lo + Vec{ extent, extent, extent } + pad);
+	}
+
+	Vec					center;
+	Scalar				halfSize;
+	std::vector<Proxy>	proxies;
+	size_t				sorted;		// proxies[0, sorted) are in Morton order
+	size_t				dead;		// tombstones anywhere in proxies
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cmath>
+
+#include "Vector3.h"
+
+template<typename T>
+struct Vector4
+{
+	T x, y, z, w;
+};
+
+typedef Vector4<float>	vec4;
+
+// Row major 4x4 matrix for row vectors (v * M), laid out and built like the DirectXMath
+// matrices the renderer uses, so a camera set up here matches what it draws.
+struct Matrix4
+{
+	float m[4][4];
+
+	static inline Matrix4 Identity()
+	{
+		return Matrix4{ {
+			{ 1.0f, 0.0f, 0.0f, 0.0f },
+			{ 0.0f, 1.0f, 0.0f, 0.0f },
+			{ 0.0f, 0.0f, 1.0f, 0.0f },
+			{ 0.0f, 0.0f, 0.0f, 1.0f } } };
+	}
+
+	// view matrix of a left handed camera at eye looking along dir, as XMMatrixLookToLH
+	static inline Matrix4 LookToLH(const vec3& eye, const vec3& dir, const vec3& up)
+	{
+		auto normalize = [](const vec3& v) { return v / std::sqrt(dot(v, v)); };
+
+		vec3 z = normalize(dir);
+		vec3 x = normalize(cross(up, z));
+		vec3 y = cross(z, x);
+
+		return Matrix4{ {
+			{ x.x, y.x, z.x, 0.0f },
+			{ x.y, y.y, z.y, 0.0f },
+			{ x.z, y.z, z.z, 0.0f },
+			{ -dot(x, eye), -dot(y, eye), -dot(z, eye), 1.0f } } };
+	}
+
+	// left handed projection mapping depth zNear..zFar to 0..1, as XMMatrixPerspectiveFovLH
+	static inline Matrix4 PerspectiveFovLH(float fovY, float aspect, float zNear, float zFar)
+	{
+		const float h = 1.0f / std::tan(fovY * 0.5f);
+		const float w = h / aspect;
+		const float r = zFar / (zFar - zNear);
+
+		return Matrix4{ {
+			{ w, 0.0f, 0.0f, 0.0f },
+			{ 0.0f, h, 0.0f, 0.0f },
+			{ 0.0f, 0.0f, r, 1.0f },
+			{ 0.0f, 0.0f, -r * zNear, 0.0f } } };
+	}
+
+	inline vec4 Transform(const vec3& p) const
+	{
+		return vec4{
+			p.x * m[0][0] + p.y * m[1][0] + p.z * m[2][0] + m[3][0],
+			p.x * m[0][1] + p.y * m[1][1] + p.z * m[2][1] + m[3][1],
+			p.x * m[0][2] + p.y * m[1][2] + p.z * m[2][2] + m[3][2],
+			p.x * m[0][3] + p.y * m[1][3] + p.z * m[2][3] + m[3][3] };
+	}
+};
+
+inline Matrix4 operator * (const Matrix4& a, const Matrix4& b)
+{
+	Matrix4 r;
+	for (int i = 0; i < 4; i++)
+	{
+		for (int j = 0; j < 4; j++)
+			r.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j] + a.m[i][3] * b.m[3][j];
+	}
+	return r;
+}
@@ -0,0 +1,239 @@
+#include "OcclusionCuller.h"
+
+#include <cmath>
+
+namespace
+{
+	// corner i has bit 0 set for max x, bit 1 for max y and bit 2 for max z
+	const int box_triangles[12][3] = {
+		{ 0, 2, 6 }, { 0, 6, 4 },		// min x
+		{ 1, 5, 7 }, { 1, 7, 3 },		// max x
+		{ 0, 4, 5 }, { 0, 5, 1 },		// min y
+		{ 2, 3, 7 }, { 2, 7, 6 },		// max y
+		{ 0, 1, 3 }, { 0, 3, 2 },		// min z
+		{ 4, 6, 7 }, { 4, 7, 5 },		// max z
+	};
+
+	void box_corners(const AABB& box, vec3 corners[8])
+	{
+		for (int i = 0; i < 8; i++)
+		{
+			corners[i] = vec3{
+				(i & 1) ? box.max.x : box.min.x,
+				(i & 2) ? box.max.y : box.min.y,
+				(i & 4) ? box.max.z : box.min.z };
+		}
+	}
+
+	// twice the signed area of a, b, p; positive inside a triangle whose own area is positive
+	inline float edge(float ax, float ay, float bx, float by, float px, float py)
+	{
+		return (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+	}
+}
+
+OcclusionCuller::OcclusionCuller(int width, int height)
+	:
+	mWidth(width),
+	mHeight(height),
+	mStride((width + 3) & ~3),
+	mNear(0.0f),
+	mEye(vec3{ 0.0f, 0.0f, 0.0f }),
+	mViewProjection(Matrix4::Identity()),
+	mDepth(static_cast<size_t>(mStride) * height, 1.0f)
+{
+
+}
+
+void OcclusionCuller::SetCamera(const vec3& eye, const vec3& dir, float fovY, float zNear, float zFar)
+{
+	mEye = eye;
+	mNear = zNear;
+	mViewProjection =
+		Matrix4::LookToLH(eye, dir, vec3{ 0.0f, 1.0f, 0.0f }) *
+		Matrix4::PerspectiveFovLH(fovY, static_cast<float>(mWidth) / static_cast<float>(mHeight), zNear, zFar);
+}
+
+void OcclusionCuller::Clear()
+{
+	std::fill(mDepth.begin(), mDepth.end(), 1.0f);
+}
+
+void OcclusionCuller::AddOccluder(const AABB& box)
+{
+	vec3 corners[8];
+	box_corners(box, corners);
+
+	ScreenVertex screen[8];
+	for (int i = 0; i < 8; i++)
+	{
+		vec4 clip = mViewProjection.Transform(corners[i]);
+		if (clip.w < mNear)
+			return;
+
+		const float inv = 1.0f / clip.w;
+		screen[i] = ScreenVertex{
+			(clip.x * inv * 0.5f + 0.5f) * static_cast<float>(mWidth),
+			(0.5f - clip.y * inv * 0.5f) * static_cast<float>(mHeight),
+			clip.z * inv };
+	}
+
+	// back faces lie behind the front ones and lose the depth test, no need to cull them
+	for (auto& tri : box_triangles)
+		RasteriseTriangle(screen[tri[0]], screen[tri[1]], screen[tri[2]]);
+}
+
+bool OcclusionCuller::IsVisible(const AABB& box) const
+{
+	vec3 corners[8];
+	box_corners(box, corners);
+
+	// all corners outside one frustum plane, or a corner behind the eye
+	int outside[6] = { 0, 0, 0, 0, 0, 0 };
+	bool straddles = false;
+
+	float minX = static_cast<float>(mWidth), maxX = 0.0f;
+	float minY = static_cast<float>(mHeight), maxY = 0.0f;
+	float minZ = 1.0f;
+
+	for (int i = 0; i < 8; i++)
+	{
+		vec4 clip = mViewProjection.Transform(corners[i]);
+
+		outside[0] += clip.x < -clip.w;
+		outside[1] += clip.x > clip.w;
+		outside[2] += clip.y < -clip.w;
+		outside[3] += clip.y > clip.w;
+		outside[4] += clip.z < 0.0f;
+		outside[5] += clip.z > clip.w;
+
+		if (clip.w < mNear)
+		{
+			straddles = true;
+			continue;
+		}
+
+		const float inv = 1.0f / clip.w;
+		const float sx = (clip.x * inv * 0.5f + 0.5f) * static_cast<float>(mWidth);
+		const float sy = (0.5f - clip.y * inv * 0.5f) * static_cast<float>(mHeight);
+		minX = std::min(minX, sx);
+		maxX = std::max(maxX, sx);
+		minY = std::min(minY, sy);
+		maxY = std::max(maxY, sy);
+		minZ = std::min(minZ, clip.z * inv);
+	}
+
+	for (int plane = 0; plane < 6; plane++)
+	{
+		if (8 == outside[plane])
+			return false;
+	}
+
+	// crosses the near plane, no rectangle to test without clipping
+	if (straddles)
+		return true;
+
+	const int x0 = std::max(static_cast<int>(std::floor(minX)), 0);
+	const int x1 = std::min(static_cast<int>(std::floor(maxX)), mWidth - 1);
+	const int y0 = std::max(static_cast<int>(std::floor(minY)), 0);
+	const int y1 = std::min(static_cast<int>(std::floor(maxY)), mHeight - 1);
+
+	for (int y = y0; y <= y1; y++)
+	{
+		const float* row = &mDepth[static_cast<size_t>(y) * mStride];
+		for (int x = x0; x <= x1; x++)
+		{
+			if (minZ <= row[x])
+				return true;
+		}
+	}
+	return false;
+}
+
+void OcclusionCuller::RasteriseTriangle(const ScreenVertex& a, const ScreenVertex& b0, const ScreenVertex& c0)
+{
+	// either winding, swap to make the area positive
+	float area = edge(a.x, a.y, b0.x, b0.y, c0.x, c0.y);
+	if (0.0f == area)
+		return;
+
+	const ScreenVertex& b = area > 0.0f ? b0 : c0;
+	const ScreenVertex& c = area > 0.0f ? c0 : b0;
+	area = std::abs(area);
+
+	// pixels whose centre lies inside the bounding rectangle
+	const int x0 = std::max(static_cast<int>(std::ceil(std::min(a.x, std::min(b.x, c.x)) - 0.5f)), 0);
+	const int x1 = std::min(static_cast<int>(std::floor(std::max(a.x, std::max(b.x, c.x)) - 0.5f)), mWidth - 1);
+	const int y0 = std::max(static_cast<int>(std::ceil(std::min(a.y, std::min(b.y, c.y)) - 0.5f)), 0);
+	const int y1 = std::min(static_cast<int>(std::floor(std::max(a.y, std::max(b.y, c.y)) - 0.5f)), mHeight - 1);
+	if (x0 > x1 || y0 > y1)
+		return;
+
+	// the edge functions and depth are affine in screen space, step them along the row
+	const float dw0dx = b.y - c.y;
+	const float dw1dx = c.y - a.y;
+	const float dw2dx = a.y - b.y;
+
+	const float invArea = 1.0f / area;
+	const float dz1 = (b.z - a.z) * invArea;
+	const float dz2 = (c.z - a.z) * invArea;
+
+	for (int y = y0; y <= y1; y++)
+	{
+		float* row = &mDepth[static_cast<size_t>(y) * mStride];
+		const float py = static_cast<float>(y) + 0.5f;
+
+#ifdef OCTREE_SIMD_SSE
+		// whole vectors from the aligned column at or left of x0, the stride pads the last one
+		const int xs = x0 & ~3;
+		const float px = static_cast<float>(xs) + 0.5f;
+
+		const __m128 lane = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+		__m128 w0 = _mm_add_ps(_mm_set1_ps(edge(b.x, b.y, c.x, c.y, px, py)), _mm_mul_ps(lane, _mm_set1_ps(dw0dx)));
+		__m128 w1 = _mm_add_ps(_mm_set1_ps(edge(c.x, c.y, a.x, a.y, px, py)), _mm_mul_ps(lane, _mm_set1_ps(dw1dx)));
+		__m128 w2 = _mm_add_ps(_mm_set1_ps(edge(a.x, a.y, b.x, b.y, px, py)), _mm_mul_ps(lane, _mm_set1_ps(dw2dx)));
+
+		const __m128 step0 = _mm_set1_ps(4.0f * dw0dx);
+		const __m128 step1 = _mm_set1_ps(4.0f * dw1dx);
+		const __m128 step2 = _mm_set1_ps(4.0f * dw2dx);
+		const __m128 za = _mm_set1_ps(a.z), zb = _mm_set1_ps(dz1), zc = _mm_set1_ps(dz2);
+		const __m128 zero = _mm_setzero_ps();
+
+		for (int x = xs; x <= x1; x += 4)
+		{
+			const __m128 inside = _mm_and_ps(_mm_cmpge_ps(w0, zero), _mm_and_ps(_mm_cmpge_ps(w1, zero), _mm_cmpge_ps(w2, zero)));
+			if (0 != _mm_movemask_ps(inside))
+			{
+				// z = a.z + w1 / area * (b.z - a.z) + w2 / area * (c.z - a.z), w1 and w2 weigh b and c
+				const __m128 z = _mm_add_ps(za, _mm_add_ps(_mm_mul_ps(w1, zb), _mm_mul_ps(w2, zc)));
+				const __m128 depth = _mm_loadu_ps(row + x);
+				const __m128 nearer = _mm_and_ps(inside, _mm_cmplt_ps(z, depth));
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(nearer, z), _mm_andnot_ps(nearer, depth)));
+			}
+
+			w0 = _mm_add_ps(w0, step0);
+			w1 = _mm_add_ps(w1, step1);
+			w2 = _mm_add_ps(w2, step2);
+		}
+#else
+		const float px = static_cast<float>(x0) + 0.5f;
+		float w0 = edge(b.x, b.y, c.x, c.y, px, py);
+		float w1 = edge(c.x, c.y, a.x, a.y, px, py);
+		float w2 = edge(a.x, a.y, b.x, b.y, px, py);
+
+		for (int x = x0; x <= x1; x++)
+		{
+			if (w0 >= 0.0f && w1 >= 0.0f && w2 >= 0.0f)
+			{
+				const float z = a.z + w1 * dz1 + w2 * dz2;
+				if (z < row[x])
+					row[x] = z;
+			}
+
+			w0 += dw0dx;
+			w1 += dw1dx;
+			w2 += dw2dx;
+		}
+#endif
+	}
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "Vector3.h"
+#include "AABB.h"
+#include "Matrix4.h"
+
+// CPU occlusion culling against a low resolution depth buffer, no graphics API involved.
+// Occluder boxes are rasterised into the buffer (SSE where available, scalar otherwise);
+// IsVisible() then compares the screen rectangle and nearest depth of a box against it.
+// Occluders count as solid, and a pixel is covered when its centre is, as in the usual
+// software culling schemes. Depth is 0 at the near and 1 at the far plane.
+class OcclusionCuller
+{
+public:
+
+	OcclusionCuller(int width, int height);
+
+	// camera of Renderer::SetCameraLookTo, y up, with a vertical field of view of fovY
+	void SetCamera(const vec3& eye, const vec3& dir, float fovY, float zNear, float zFar);
+
+	// resets every pixel to the far plane, keeping the camera
+	void Clear();
+
+	// occluders with a corner in front of the near plane are skipped, as they would need clipping
+	void AddOccluder(const AABB& box);
+
+	// false when box is outside the view or behind the occluders drawn so far
+	bool IsVisible(const AABB& box) const;
+
+	// Walks tree front to back, skipping every subtree whose loose bound is hidden, and calls
+	// func(T*) for each object whose box is visible. When func returns true the object box
+	// is added as an occluder for everything after it.
+	template<typename Tree, typename F>
+	void QueryVisible(const Tree& tree, F&& func);
+
+	inline int GetWidth() const { return mWidth; }
+	inline int GetHeight() const { return mHeight; }
+
+	inline float GetDepth(int x, int y) const { return mDepth[static_cast<size_t>(y) * mStride + x]; }
+
+	inline const vec3& GetEye() const { return mEye; }
+	inline const Matrix4& GetViewProjection() const { return mViewProjection; }
+
+private:
+	struct ScreenVertex
+	{
+		float	x, y, z;
+	};
+
+	void RasteriseTriangle(const ScreenVertex& a, const ScreenVertex& b, const ScreenVertex& c);
+
+	int					mWidth;
+	int					mHeight;
+	int					mStride;		// width rounded up to whole SSE vectors
+	float				mNear;
+	vec3				mEye;
+	Matrix4				mViewProjection;
+	std::vector<float>	mDepth;
+};
+
+template<typename Tree, typename F>
+void OcclusionCuller::QueryVisible(const Tree& tree, F&& func)
+{
+	typedef typename Tree::Node Node;
+
+	std::vector<const Node*> stack;
+	stack.push_back(tree.GetRoot());
+
+	while (!stack.empty())
+	{
+		const Node* node = stack.back();
+		stack.pop_back();
+
+		if (!IsVisible(AABB(tree.LooseBound(node))))
+			continue;
+
+		for (auto p = node->objects; nullptr != p; p = p->next)
+		{
+			const AABB box = AABB(p->GetAABB());
+			if (IsVisible(box) && func(p->object))
+				AddOccluder(box);
+		}
+
+		if (node->IsLeaf())
+			continue;
+
+		// push the far children first so the nearest one is walked next
+		std::pair<float, const Node*> children[8];
+		size_t count = 0;
+		for (size_t i = 0; i < 8; i++)
+		{
+			const Node* child = node->GetChild(i);
+			if (nullptr == child)
+				continue;
+
+			const vec3 d = static_cast<vec3>(child->bound.center) - mEye;
+			children[count++] = std::make_pair(dot(d, d), child);
+		}
+
+		// insertion sort, farthest first; at most eight entries
+		for (size_t i = 1; i < count; i++)
+		{
+			for (size_t j = i; j > 0 && children[j - 1].first < children[j].first; j--)
+				std::swap(children[j - 1], children[j]);
+		}
+		for (size_t i = 0; i < count; i++)
+			stack.push_back(children[i].second);
+	}
+}
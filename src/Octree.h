@@ -1,77 +1,161 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
 #include "Vector3.h"
 #include "AABB.h"
+#include "OctreeIterator.h"
+#include "OctreePool.h"
+#include "OctreeWorkerPool.h"
 
-#pragma pack(push, 4)
-struct NodeBoundingBox
+template<typename S>
+struct TNodeBoundingBox
 {
-	vec3	center;
-	float	halfSize;
+	Vector3<S>	center;
+	S			halfSize;
 
-	inline operator AABB() const { return AABB(center, halfSize); }
+	inline operator TAABB<S>() const { return TAABB<S>(center, halfSize); }
+};
+
+typedef TNodeBoundingBox<float>		NodeBoundingBox;
+typedef TNodeBoundingBox<double>	dNodeBoundingBox;
+
+// Types of a tree over T, the scalar type is taken from the box T::GetAABB() returns,
+// so objects reporting a dAABB give a double precision tree.
+template<typename T>
+struct OctreeTraits
+{
+	typedef typename std::decay<decltype(std::declval<const T&>().GetAABB())>::type aabb_type;
+	typedef typename aabb_type::scalar_type scalar_type;
+	typedef Vector3<scalar_type> vec_type;
+	typedef TNodeBoundingBox<scalar_type> bound_type;
 };
-#pragma pack(pop)
 
 template<typename T>
 struct OctreeData
 {
 	OctreeData<T>*	next;
 	T*				object;
+	uint64_t		version = 0;	// Octree version of the insert
 
 	//
-	inline const AABB& AABB() const { return object->GetAABB(); }
+	inline decltype(auto) GetAABB() const { return object->GetAABB(); }
 };
 
-template<typename T>
+// Default aggregate policy, keeps no per-node data.
+// A policy provides value_type, Empty(), FromObject(const T&) and Combine(a, b); every node
+// then holds the combined value of all objects in its subtree.
+struct NoAggregate
+{
+	struct value_type {};
+
+	static inline value_type Empty() { return value_type(); }
+
+	template<typename T>
+	static inline value_type FromObject(const T&) { return value_type(); }
+
+	static inline value_type Combine(const value_type&, const value_type&) { return value_type(); }
+};
+
+// Aggregate policy keeping the tight union AABB of everything in a subtree.
+// Policies that define Intersects(value, box) let queries reject a node on its aggregate
+// before descending, which is much tighter than the cubic node bound in sparse scenes.
+template<typename S>
+struct TTightBoundsAggregate
+{
+	typedef TAABB<S> value_type;
+
+	static inline value_type Empty()
+	{
+		const S inf = std::numeric_limits<S>::infinity();
+		return value_type(Vector3<S>{ inf, inf, inf }, Vector3<S>{ -inf, -inf, -inf });
+	}
+
+	template<typename T>
+	static inline value_type FromObject(const T& object) { return object.GetAABB(); }
+
+	static inline value_type Combine(const value_type& a, const value_type& b) { return a.Union(b); }
+
+	static inline bool Intersects(const value_type& value, const value_type& box) { return value.Intersects(box); }
+};
+
+typedef TTightBoundsAggregate<float>	TightBoundsAggregate;
+typedef TTightBoundsAggregate<double>	dTightBoundsAggregate;
+
+template<typename A, typename B, typename = void>
+struct OctreeAggregateBounds
+{
+	static inline bool Intersects(const typename A::value_type&, const B&) { return true; }
+};
+
+template<typename A, typename B>
+struct OctreeAggregateBounds<A, B, decltype(void(A::Intersects(std::declval<const typename A::value_type&>(), std::declval<const B&>())))>
+{
+	static inline bool Intersects(const typename A::value_type& value, const B& box) { return A::Intersects(value, box); }
+};
+
+template<typename T, typename A = NoAggregate>
 struct OctreeNode
 {
+	typedef typename A::value_type Aggregate;
+	typedef typename OctreeTraits<T>::scalar_type Scalar;
+	typedef typename OctreeTraits<T>::vec_type Vec;
+	typedef typename OctreeTraits<T>::bound_type Bound;
+
 	OctreeNode**	children;
 	OctreeNode*		parent;
-	NodeBoundingBox	bound;
+	Bound			bound;
 	OctreeData<T>*	objects;
+	Aggregate		aggregate;
+	uint64_t		version;	// Octree version of the latest change in the subtree
+	uint64_t		created;	// Octree version that created the node
+	uint32_t		count;		// entries linked in objects
+	bool			settled;	// split without any object moving down, see Octree::Insert
+	unsigned char	index;
 
-	OctreeNode(const vec3& center, float halfSize)
+	OctreeNode(const Vec& center, Scalar halfSize)
 		:
 		children(nullptr),
 		parent(nullptr),
-		bound(NodeBoundingBox{ center, halfSize }),
-		objects(nullptr)
+		bound(Bound{ center, halfSize }),
+		objects(nullptr),
+		aggregate(A::Empty()),
+		version(0),
+		created(0),
+		count(0),
+		settled(false),
+		index(0)
 	{
 
 	}
 
-	~OctreeNode()
-	{
-		if (nullptr != children)
-		{
-			// TODO clear children
-			children = nullptr;
-		}
-
-		if (nullptr != objects)
-		{
-			// TODO clear object nodes
-			objects = nullptr;
-		}
-	}
-
-	inline const NodeBoundingBox& GetBound() const { return bound; }
+	inline const Bound& GetBound() const { return bound; }
 
 	inline bool IsLeaf() const { return nullptr == children; }
 
-	inline NodeBoundingBox GetChildBound(size_t idx) const
+	inline Bound GetChildBound(size_t idx) const
 	{
 		auto child = GetChild(idx);
 		if (nullptr != child)
 			return child->GetBound();
 
-		vec3 d{ (idx & 1) - 0.5f, ((idx >> 1) & 1) - 0.5f, ((idx >> 2 & 1)) - 0.5f };
-		vec3 c = bound.center + d * bound.halfSize;
-		return NodeBoundingBox{ c, bound.halfSize * 0.5f };
+		const Scalar half = Scalar(0.5);
+		Vec d{ (idx & 1) - half, ((idx >> 1) & 1) - half, ((idx >> 2 & 1)) - half };
+		Vec c = bound.center + d * bound.halfSize;
+		return Bound{ c, bound.halfSize * half };
 	}
 
-	inline OctreeNode<T>* GetChild(size_t idx) const
+	inline OctreeNode* GetChild(size_t idx) const
 	{
 		if (IsLeaf())
 			return nullptr;
@@ -79,85 +163,1170 @@ struct OctreeNode
 			return children[idx];
 	}
 
-	inline void SetChild(size_t idx, OctreeNode<T>* node)
+	// the owning Octree allocates the children array before the first SetChild
+	inline void SetChild(size_t idx, OctreeNode* node)
 	{
-		if (nullptr == children)
-			children = new OctreeNode*[8]{ nullptr };
-
 		children[idx] = node;
+		if (nullptr != node)
+			node->index = static_cast<unsigned char>(idx);
 	}
 
-	inline void Insert(T* object)
+	// links an existing entry at the front of the object list
+	inline void Insert(OctreeData<T>* n)
 	{
-		auto n = new OctreeData<T>{ nullptr, object };
+		n->next = objects;
+		objects = n;
+		count++;
+	}
 
-		if (nullptr == objects)
+	// unlinks and returns the entry of object, nullptr if it is not stored here
+	inline OctreeData<T>* Unlink(T* object)
+	{
+		for (auto link = &objects; nullptr != *link; link = &(*link)->next)
 		{
-			objects = n;
+			if ((*link)->object == object)
+			{
+				auto n = *link;
+				*link = n->next;
+				count--;
+				return n;
+			}
 		}
-		else
+		return nullptr;
+	}
+
+	// recomputes the aggregate from the objects stored here and the children aggregates
+	inline void UpdateAggregate()
+	{
+		Aggregate value = A::Empty();
+
+		for (auto p = objects; nullptr != p; p = p->next)
+			value = A::Combine(value, A::FromObject(*p->object));
+
+		if (!IsLeaf())
 		{
-			auto p = objects;
-			while (nullptr != p->next)
-				p = p->next;
-			p->next = n;
+			for (size_t i = 0; i < 8; i++)
+			{
+				if (nullptr != children[i])
+					value = A::Combine(value, children[i]->aggregate);
+			}
 		}
+
+		aggregate = value;
 	}
 };
 
-template<typename T, int MAX_DEPTH>
+// MAX_DEPTH value selecting the depth from OctreeConfig::maxDepth at run time
+constexpr int OCTREE_DYNAMIC_DEPTH = -1;
+
+// deepest tree a dynamic depth Octree supports, sizes its traversal stacks
+constexpr int OCTREE_MAX_DYNAMIC_DEPTH = 21;
+
+struct OctreeConfig
+{
+	int		maxDepth = 8;			// only used when MAX_DEPTH is OCTREE_DYNAMIC_DEPTH
+	float	minNodeSize = 0.0f;		// no child node with a smaller edge length is created
+	size_t	bucketSize = 0;			// objects a leaf holds before it splits, 0 pushes objects down eagerly
+	float	looseness = 1.0f;		// node bounds are scaled by this for classification and queries
+	bool	quantised = false;		// classify on an integer grid relative to the root, see Octree::Quantise
+	bool	history = false;		// log removals and pruned nodes for Octree::DiffSince
+};
+
+// Id of an object in a delta: T::GetID() when it exists, otherwise the object address,
+// which only identifies it within the process.
+template<typename T, typename = void>
+struct OctreeObjectID
+{
+	static inline uint64_t Get(const T& object) { return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(&object)); }
+};
+
+template<typename T>
+struct OctreeObjectID<T, decltype(void(std::declval<const T&>().GetID()))>
+{
+	static inline uint64_t Get(const T& object) { return static_cast<uint64_t>(object.GetID()); }
+};
+
+// Changes of an Octree between two versions, as produced by Octree::DiffSince.
+// A reset delta is a full snapshot, the receiver drops what it has before applying it.
+template<typename S>
+struct TOctreeDelta
+{
+	struct Object
+	{
+		uint64_t	id;
+		TAABB<S>	box;
+	};
+
+	uint64_t						since = 0;
+	uint64_t						version = 0;
+	bool							reset = false;
+
+	std::vector<Object>				added;
+	std::vector<Object>				moved;			// removed and inserted again, with the new box
+	std::vector<uint64_t>			removed;		// may name objects added and removed in between
+	std::vector<TNodeBoundingBox<S>>	createdNodes;
+	std::vector<TNodeBoundingBox<S>>	prunedNodes;	// a node pruned and created again is in both
+};
+
+typedef TOctreeDelta<float>		OctreeDelta;
+typedef TOctreeDelta<double>	dOctreeDelta;
+
+#ifdef OCTREE_ENABLE_STATS
+// counters accumulated by every Query since the last Octree::ResetQueryStats()
+struct OctreeQueryStats
+{
+	size_t	queries = 0;
+	size_t	nodesVisited = 0;		// nodes popped, including the ones rejected on their bound
+	size_t	aabbTests = 0;			// node and object box tests
+	size_t	hits = 0;				// objects passed to the callback
+};
+
+// shape of a tree as reported by Octree::GetStats()
+struct OctreeStats
+{
+	size_t				nodeCount = 0;
+	size_t				objectCount = 0;
+	size_t				interiorObjects = 0;	// objects held by nodes that have children
+	size_t				memoryBytes = 0;		// nodes, child arrays and object entries
+	size_t				reservedBytes = 0;		// storage the tree holds for them, including freed slots
+	std::vector<size_t>	nodesPerLevel;			// indexed by depth, the root is at 0
+	std::vector<size_t>	objectsPerNode;			// [0] empty nodes, [i] nodes holding 2^(i-1) to 2^i - 1 objects
+	OctreeQueryStats	queries;
+};
+#endif
+
+// MAX_DEPTH is either a compile time depth, which keeps the depth checks constant folded,
+// or OCTREE_DYNAMIC_DEPTH to take it from the OctreeConfig passed at construction.
+template<typename T, int MAX_DEPTH, typename A = NoAggregate>
 class Octree
 {
+	static_assert(OCTREE_DYNAMIC_DEPTH == MAX_DEPTH || (0 <= MAX_DEPTH && MAX_DEPTH <= OCTREE_MAX_DYNAMIC_DEPTH), "unsupported MAX_DEPTH");
+
+	static constexpr int STACK_DEPTH = OCTREE_DYNAMIC_DEPTH == MAX_DEPTH ? OCTREE_MAX_DYNAMIC_DEPTH : MAX_DEPTH;
+
 public:
 
-	typedef OctreeNode<T> Node;
+	typedef OctreeNode<T, A> Node;
+	typedef typename A::value_type Aggregate;
+	typedef typename OctreeTraits<T>::scalar_type Scalar;
+	typedef typename OctreeTraits<T>::vec_type Vec;
+	typedef typename OctreeTraits<T>::aabb_type Box;
+	typedef typename OctreeTraits<T>::bound_type Bound;
+
+	inline Octree(Vec center, Scalar halfSize, const OctreeConfig& newConfig = OctreeConfig())
+		: root(nullptr), config(Sanitize(newConfig)), version(0), historyStart(0)
+	{
+		root = NewNode(center, halfSize);
+	}
+
+	Octree(const Octree&) = delete;
+	Octree& operator = (const Octree&) = delete;
+
+	// nodes, child arrays and object entries live in the pools, which free their blocks
+	inline ~Octree() { ReleaseNodes(); }
+
+	inline void Insert(T* object)
+	{
+		if (!LooseBound(root).Contains(object->GetAABB()))
+		{
+			// TODO expand tree
+			return;
+		}
+
+		NextVersion();
+		Insert(new (entryPool.Allocate()) OctreeData<T>{ nullptr, object, version });
+	}
+
+	// object must still report the AABB it was inserted with
+	inline bool Remove(T* object)
+	{
+		const ObjectKey key = MakeKey(object->GetAABB());
+
+		Node* node = root;
+		OctreeData<T>* entry = nullptr;
+		int depth = 0;
+		while (nullptr != node && nullptr == (entry = node->Unlink(object)))
+		{
+			int idx = CanSplit(node, depth) ? ChildIndex(node, depth, key) : -1;
+			depth++;
+			node = idx < 0 ? nullptr : node->GetChild(idx);
+		}
 
-	inline Octree(vec3 center, float halfSize)
-		: root(new Node(center, halfSize)) { }
+		if (nullptr == node)
+			return false;
+
+		NextVersion();
+		if (config.history)
+			removals.push_back(Removal{ OctreeObjectID<T>::Get(*object), version });
+
+		entryPool.Free(entry);
+		Touch(node);
+		Prune(node);
+		return true;
+	}
+
+	// Removes every object and node but keeps their storage for the following inserts, so a
+	// tree rebuilt every frame stops allocating once it has reached its working size.
+	// Amortised O(1): nodes are only visited when their aggregate needs destroying.
+	inline void Clear()
+	{
+		const Bound bound = root->bound;
+		ReleaseNodes();
+		entryPool.Reset();
+		ResetHistory();
+		root = NewNode(bound.center, bound.halfSize);
+	}
+
+	// re-roots the tree at new bounds, relinking the existing object entries into fresh nodes;
+	// returns how many objects no longer fit and were dropped
+	inline size_t Rebuild(Vec center, Scalar halfSize) { return Rebuild(center, halfSize, config); }
+
+	inline size_t Rebuild(Vec center, Scalar halfSize, const OctreeConfig& newConfig)
+	{
+		OctreeData<T>* entries = nullptr;
+		for (const Node* n : Nodes())
+		{
+			Node* node = const_cast<Node*>(n);
+			while (nullptr != node->objects)
+			{
+				auto entry = node->objects;
+				node->objects = entry->next;
+				entry->next = entries;
+				entries = entry;
+			}
+		}
+
+		ReleaseNodes();
+		ResetHistory();
+		root = NewNode(center, halfSize);
+		config = Sanitize(newConfig);
+
+		size_t dropped = 0;
+		while (nullptr != entries)
+		{
+			auto n = entries;
+			entries = n->next;
+
+			if (LooseBound(root).Contains(n->GetAABB()))
+			{
+				Insert(n);
+			}
+			else
+			{
+				entryPool.Free(n);
+				dropped++;
+			}
+		}
+		return dropped;
+	}
+
+	// Moves the tree origin to offset: every node centre is shifted by -offset, keeping the
+	// structure, so a large world can be re-centred around the camera without reinserting.
+	// Call it after shifting every object by -offset; aggregates are recomputed from them.
+	inline void Rebase(const Vec& offset)
+	{
+		std::vector<Node*> nodes;
+		for (const Node* n : NodesBreadthFirst())
+			nodes.push_back(const_cast<Node*>(n));
+
+		for (auto it = nodes.rbegin(); it != nodes.rend(); ++it)
+		{
+			(*it)->bound.center = (*it)->bound.center - offset;
+			if (!std::is_same<A, NoAggregate>::value)
+				(*it)->UpdateAggregate();
+		}
+		ResetHistory();
+	}
+
+	// every Insert and Remove advances the version and stamps the nodes on its path
+	inline uint64_t GetVersion() const { return version; }
+
+	// Changes since version for a follower at that version, see TOctreeDelta. Only subtrees
+	// stamped later are walked, so the cost follows the amount of change. Removals and pruned
+	// nodes come from the history log; without config.history, after TrimHistory past since
+	// and after Clear, Rebuild or Rebase the delta is a reset holding every object and node.
+	inline void DiffSince(uint64_t since, TOctreeDelta<Scalar>& delta) const
+	{
+		typedef typename TOctreeDelta<Scalar>::Object DeltaObject;
+
+		delta = TOctreeDelta<Scalar>();
+		delta.since = since;
+		delta.version = version;
+		delta.reset = since < historyStart;
+
+		std::vector<DeltaObject> changed;
+		std::vector<const Node*> stack;
+		stack.push_back(root);
+		while (!stack.empty())
+		{
+			const Node* node = stack.back();
+			stack.pop_back();
+
+			if (!delta.reset && node->version <= since)
+				continue;
+
+			if (delta.reset || node->created > since)
+				delta.createdNodes.push_back(node->bound);
+
+			for (auto p = node->objects; nullptr != p; p = p->next)
+			{
+				if (delta.reset || p->version > since)
+					changed.push_back(DeltaObject{ OctreeObjectID<T>::Get(*p->object), p->GetAABB() });
+			}
+
+			for (size_t i = 0; i < 8; i++)
+			{
+				const Node* child = node->GetChild(i);
+				if (nullptr != child)
+					stack.push_back(child);
+			}
+		}
+
+		if (delta.reset)
+		{
+			delta.added = std::move(changed);
+			return;
+		}
+
+		// the logs are in version order
+		auto removal = std::upper_bound(removals.begin(), removals.end(), since, [](uint64_t v, const Removal& r) { return v < r.version; });
+		std::unordered_set<uint64_t> removedIDs;
+		for (; removal != removals.end(); ++removal)
+			removedIDs.insert(removal->id);
+
+		for (auto& object : changed)
+		{
+			if (0 != removedIDs.erase(object.id))
+				delta.moved.push_back(object);
+			else
+				delta.added.push_back(object);
+		}
+		delta.removed.assign(removedIDs.begin(), removedIDs.end());
+
+		auto pruned = std::upper_bound(prunedNodes.begin(), prunedNodes.end(), since, [](uint64_t v, const PrunedNode& p) { return v < p.version; });
+		for (; pruned != prunedNodes.end(); ++pruned)
+			delta.prunedNodes.push_back(pruned->bound);
+	}
+
+	// drops the history up to version, followers older than that get a reset delta
+	inline void TrimHistory(uint64_t upTo)
+	{
+		if (upTo > version)
+			upTo = version;
+		if (upTo <= historyStart)
+			return;
+
+		historyStart = upTo;
+		removals.erase(removals.begin(), std::upper_bound(removals.begin(), removals.end(), upTo, [](uint64_t v, const Removal& r) { return v < r.version; }));
+		prunedNodes.erase(prunedNodes.begin(), std::upper_bound(prunedNodes.begin(), prunedNodes.end(), upTo, [](uint64_t v, const PrunedNode& p) { return v < p.version; }));
+	}
+
+	// single precision bound of node relative to origin, for float local frames inside a
+	// double precision tree
+	inline AABB GetLocalBound(const Node* node, const Vec& origin) const { return LooseBound(node).Relative(origin); }
+
+	inline const OctreeConfig& GetConfig() const { return config; }
+
+	inline int GetMaxDepth() const { return OCTREE_DYNAMIC_DEPTH == MAX_DEPTH ? config.maxDepth : MAX_DEPTH; }
+
+	// node bound scaled by the looseness, what classification and queries test against;
+	// in quantised mode it is padded by one grid cell to cover rounding at cell edges
+	inline Box LooseBound(const Node* node) const
+	{
+		Scalar pad = config.quantised ? root->bound.halfSize * 2 / static_cast<Scalar>(1 << GetMaxDepth()) : Scalar(0);
+		return Box(node->bound.center, node->bound.halfSize * static_cast<Scalar>(config.looseness) + pad);
+	}
+
+	// Maps a box onto the integer grid of 2^depth cells per axis spanning the root, clamped
+	// to the grid. Classification then only compares grid coordinates, so it is exact and
+	// gives the same tree on every machine for the same input.
+	inline void Quantise(const Box& box, ivec3& gmin, ivec3& gmax) const
+	{
+		const int cells = 1 << GetMaxDepth();
+		const Scalar scale = static_cast<Scalar>(cells) / (root->bound.halfSize * 2);
+		const Vec origin = root->bound.center - Vec{ root->bound.halfSize, root->bound.halfSize, root->bound.halfSize };
+
+		auto cell = [cells, scale](Scalar v, Scalar o)
+		{
+			Scalar f = (v - o) * scale;
+			return f <= 0 ? 0 : (f >= static_cast<Scalar>(cells) ? cells - 1 : static_cast<int>(f));
+		};
+
+		gmin = ivec3{ cell(box.min.x, origin.x), cell(box.min.y, origin.y), cell(box.min.z, origin.z) };
+		gmax = ivec3{ cell(box.max.x, origin.x), cell(box.max.y, origin.y), cell(box.max.z, origin.z) };
+	}
+
+	// calls func(T*) for every object whose AABB intersects box
+	template<typename F>
+	inline void Query(const Box& box, F&& func) const
+	{
+		auto all = [](const Aggregate&) { return true; };
+		Query(box, all, func);
+	}
+
+	// as Query, but skips every subtree whose aggregate fails filter(const Aggregate&)
+	// and every object for which filter(A::FromObject(object)) fails
+	template<typename P, typename F>
+	inline void Query(const Box& box, P&& filter, F&& func) const
+	{
+		QueryCounters counters;
+		Query(root, box, filter, func, counters);
+#ifdef OCTREE_ENABLE_STATS
+		counters.queries = 1;
+		MergeQueryStats(counters);
+#endif
+	}
+
+	// Query spread over the workers of pool, appending the hits to out in no particular order.
+	// Nodes above cutoffDepth become one task each, deeper subtrees are walked serially by the
+	// task that reaches them; every worker collects into its own buffer, merged at the end.
+	// The tree must not change while the query runs.
+	inline void QueryParallel(const Box& box, std::vector<T*>& out, OctreeWorkerPool& pool, int cutoffDepth = 3) const
+	{
+		const size_t workers = pool.GetWorkerCount();
+		std::vector<std::vector<T*>> buffers(workers);
+		std::vector<QueryCounters> counters(workers);
+		auto all = [](const Aggregate&) { return true; };
+
+		std::function<void(size_t, const Node*, int)> visit = [&](size_t worker, const Node* node, int depth)
+		{
+			std::vector<T*>& hits = buffers[worker];
+			auto collect = [&hits](T* object) { hits.push_back(object); };
+
+			if (depth >= cutoffDepth || node->IsLeaf())
+			{
+				Query(node, box, all, collect, counters[worker]);
+				return;
+			}
+
+#ifdef OCTREE_ENABLE_STATS
+			counters[worker].nodesVisited++;
+			counters[worker].aabbTests++;
+#endif
+
+			if (!LooseBound(node).Intersects(box) ||
+				!OctreeAggregateBounds<A, Box>::Intersects(node->aggregate, box))
+				return;
+
+			for (auto p = node->objects; nullptr != p; p = p->next)
+			{
+#ifdef OCTREE_ENABLE_STATS
+				counters[worker].aabbTests++;
+#endif
+				if (p->GetAABB().Intersects(box))
+				{
+#ifdef OCTREE_ENABLE_STATS
+					counters[worker].hits++;
+#endif
+					hits.push_back(p->object);
+				}
+			}
+
+			for (size_t i = 0; i < 8; i++)
+			{
+				const Node* child = node->GetChild(i);
+				if (nullptr != child)
+					pool.Spawn(worker, [&visit, child, depth](size_t w) { visit(w, child, depth + 1); });
+			}
+		};
+
+		pool.Run([&visit, this](size_t worker) { visit(worker, root, 0); });
+
+		size_t total = out.size();
+		for (auto& hits : buffers)
+			total += hits.size();
+		out.reserve(total);
+		for (auto& hits : buffers)
+			out.insert(out.end(), hits.begin(), hits.end());
+
+#ifdef OCTREE_ENABLE_STATS
+		counters[0].queries = 1;
+		for (auto& c : counters)
+			MergeQueryStats(c);
+#endif
+	}
+
+	// Sweeps box by delta over t in [0, 1] and calls func(T*, Scalar t) for every object it
+	// touches, in order of the time of first contact t. Nodes are opened in the same order,
+	// so objects behind the first hit are never tested. func returns true to confirm a hit,
+	// which ends the query; returns whether that happened.
+	template<typename F>
+	inline bool QuerySwept(const Box& box, const Vec& delta, F&& func) const
+	{
+		struct Entry
+		{
+			Scalar			t;
+			const Node*		node;		// nullptr for an object entry
+			T*				object;
+
+			inline bool operator < (const Entry& other) const { return t > other.t; }
+		};
+
+		// the aggregate only knows static boxes, test it against the whole swept volume
+		const Box swept = box.Union(Box(box.min + delta, box.max + delta));
+
+		QueryCounters counters;
+		(void)counters;
+
+		std::priority_queue<Entry> open;
+		bool hit = false;
+		Scalar tEnter, tExit;
+
+#ifdef OCTREE_ENABLE_STATS
+		counters.aabbTests++;
+#endif
+		if (box.Sweep(delta, LooseBound(root), tEnter, tExit))
+			open.push(Entry{ tEnter, root, nullptr });
+
+		while (!hit && !open.empty())
+		{
+			const Entry entry = open.top();
+			open.pop();
+
+			if (nullptr == entry.node)
+			{
+#ifdef OCTREE_ENABLE_STATS
+				counters.hits++;
+#endif
+				hit = func(entry.object, entry.t);
+				continue;
+			}
 
-	inline void Insert(T* object) { Insert(root, object, MAX_DEPTH); }
+			const Node* node = entry.node;
+
+#ifdef OCTREE_ENABLE_STATS
+			counters.nodesVisited++;
+#endif
+
+			if (!OctreeAggregateBounds<A, Box>::Intersects(node->aggregate, swept))
+				continue;
+
+			for (auto p = node->objects; nullptr != p; p = p->next)
+			{
+#ifdef OCTREE_ENABLE_STATS
+				counters.aabbTests++;
+#endif
+				if (box.Sweep(delta, p->GetAABB(), tEnter, tExit))
+					open.push(Entry{ tEnter, nullptr, p->object });
+			}
+
+			if (node->IsLeaf())
+				continue;
+
+			for (size_t i = 0; i < 8; i++)
+			{
+				const Node* child = node->GetChild(i);
+				if (nullptr == child)
+					continue;
+
+#ifdef OCTREE_ENABLE_STATS
+				counters.aabbTests++;
+#endif
+				if (box.Sweep(delta, LooseBound(child), tEnter, tExit))
+					open.push(Entry{ tEnter, child, nullptr });
+			}
+		}
+
+#ifdef OCTREE_ENABLE_STATS
+		counters.queries = 1;
+		MergeQueryStats(counters);
+#endif
+		return hit;
+	}
+
+	// Level of detail cut: appends to cut the nodes where refinement stops, descending from
+	// the root while metric(const Node*) is above threshold. Nodes with the largest error are
+	// refined first, and with maxNodes set no refinement happens that would take the cut past
+	// it. Every leaf lies below exactly one cut node; objects held by refined interior nodes
+	// stay with those. See OctreeLod.h for distance and screen space metrics.
+	template<typename M>
+	inline void SelectCut(M&& metric, Scalar threshold, std::vector<const Node*>& cut, size_t maxNodes = 0) const
+	{
+		struct Entry
+		{
+			Scalar			error;
+			const Node*		node;
+
+			inline bool operator < (const Entry& other) const { return error < other.error; }
+		};
+
+		std::priority_queue<Entry> open;
+		open.push(Entry{ metric(root), root });
+
+		const size_t first = cut.size();
+		while (!open.empty())
+		{
+			const Entry entry = open.top();
+			open.pop();
+
+			// the largest error left is small enough, so is every other one
+			if (entry.error <= threshold)
+			{
+				cut.push_back(entry.node);
+				for (; !open.empty(); open.pop())
+					cut.push_back(open.top().node);
+				break;
+			}
+
+			size_t children = 0;
+			for (size_t i = 0; i < 8; i++)
+				children += nullptr != entry.node->GetChild(i) ? 1 : 0;
+
+			// the node gives way to its children, other nodes may still fit the budget
+			if (0 == children || (0 != maxNodes && cut.size() - first + open.size() + children > maxNodes))
+			{
+				cut.push_back(entry.node);
+				continue;
+			}
+
+			for (size_t i = 0; i < 8; i++)
+			{
+				const Node* child = entry.node->GetChild(i);
+				if (nullptr != child)
+					open.push(Entry{ metric(child), child });
+			}
+		}
+	}
 
 	inline const Node* GetRoot() const { return root; }
 
+	typedef OctreeDepthFirstIterator<Node, STACK_DEPTH> NodeIterator;
+	typedef OctreeBreadthFirstIterator<Node> BreadthFirstNodeIterator;
+	typedef OctreeObjectIterator<T, Node, STACK_DEPTH> ObjectIterator;
+
+	// pre-order depth first range over all nodes
+	inline OctreeRange<NodeIterator> Nodes() const { return OctreeRange<NodeIterator>{ NodeIterator(root), NodeIterator() }; }
+
+	// level order range over all nodes
+	inline OctreeRange<BreadthFirstNodeIterator> NodesBreadthFirst() const
+	{
+		return OctreeRange<BreadthFirstNodeIterator>{ BreadthFirstNodeIterator(root), BreadthFirstNodeIterator() };
+	}
+
+	// range-for over an Octree visits every object
+	inline ObjectIterator begin() const { return ObjectIterator(root); }
+	inline ObjectIterator end() const { return ObjectIterator(); }
+
+	// Node adjacent to node across direction (components in {-1, 0, 1}, so faces, edges and
+	// corners). Returns the node of the same depth if it exists, otherwise the smallest
+	// existing node covering that position; nullptr outside the root or when the only
+	// covering node also contains node itself.
+	static inline const Node* FindNeighbor(const Node* node, const ivec3& direction)
+	{
+		const int d[3] = { direction.x, direction.y, direction.z };
+		const Node* parent = node->parent;
+
+		if (0 == d[0] && 0 == d[1] && 0 == d[2])
+			return node;
+		if (nullptr == parent)
+			return nullptr;
+
+		// mirror the child index bits along direction, carrying upwards where we leave the parent
+		size_t mirrored = node->index;
+		int carry[3] = { 0, 0, 0 };
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (0 == d[axis])
+				continue;
+
+			bool upper = 0 != ((node->index >> axis) & 1);
+			mirrored ^= size_t(1) << axis;
+			if (upper == (d[axis] > 0))
+				carry[axis] = d[axis];
+		}
+
+		if (0 == carry[0] && 0 == carry[1] && 0 == carry[2])
+			return parent->GetChild(mirrored);
+
+		const Node* target = FindNeighbor(parent, ivec3{ carry[0], carry[1], carry[2] });
+		if (nullptr == target || target->bound.halfSize != parent->bound.halfSize)
+			return target;
+
+		const Node* child = target->GetChild(mirrored);
+		return nullptr != child ? child : target;
+	}
+
+	// calls func(const Node* neighbor, const ivec3& direction) once per distinct neighbour
+	// over the 6 faces, or all 26 faces, edges and corners when faceOnly is false
+	template<typename F>
+	static inline void ForEachNeighbor(const Node* node, F&& func, bool faceOnly = true)
+	{
+		const Node* seen[26];
+		size_t count = 0;
+
+		for (int z = -1; z <= 1; z++)
+		{
+			for (int y = -1; y <= 1; y++)
+			{
+				for (int x = -1; x <= 1; x++)
+				{
+					int axes = (0 != x) + (0 != y) + (0 != z);
+					if (0 == axes || (faceOnly && 1 != axes))
+						continue;
+
+					ivec3 direction{ x, y, z };
+					const Node* neighbor = FindNeighbor(node, direction);
+					if (nullptr == neighbor)
+						continue;
+
+					bool duplicate = false;
+					for (size_t i = 0; i < count && !duplicate; i++)
+						duplicate = seen[i] == neighbor;
+					if (duplicate)
+						continue;
+
+					seen[count++] = neighbor;
+					func(neighbor, direction);
+				}
+			}
+		}
+	}
+
+	// Checks the structural invariants: parent and child links agree, every child is an
+	// octant of its parent no deeper than the maximum depth, only the root may be an empty
+	// leaf, and every object lies inside the loose bound of the node storing it.
+	inline bool Validate() const
+	{
+		if (nullptr == root || nullptr != root->parent)
+			return false;
+
+		for (NodeIterator it(root); !it.IsEnd(); ++it)
+		{
+			const Node* node = *it;
+
+			if (it.GetDepth() > GetMaxDepth())
+				return false;
+			if (node != root && node->IsLeaf() && nullptr == node->objects)
+				return false;
+
+			Box loose = LooseBound(node);
+			size_t count = 0;
+			for (auto p = node->objects; nullptr != p; p = p->next)
+			{
+				if (nullptr == p->object || !loose.Contains(p->GetAABB()))
+					return false;
+				count++;
+			}
+			if (count != node->count)
+				return false;
+
+			if (node->IsLeaf())
+				continue;
+
+			bool empty = true;
+			for (size_t i = 0; i < 8; i++)
+			{
+				const Node* child = node->GetChild(i);
+				if (nullptr == child)
+					continue;
+
+				empty = false;
+				if (child->parent != node || child->index != i ||
+					child->bound.halfSize != node->bound.halfSize * Scalar(0.5) ||
+					!Box(node->bound.center, node->bound.halfSize).Contains(child->bound.center))
+					return false;
+			}
+			if (empty)
+				return false;
+		}
+		return true;
+	}
+
+#ifdef OCTREE_ENABLE_STATS
+	inline OctreeStats GetStats() const
+	{
+		OctreeStats stats;
+		stats.queries = GetQueryStats();
+		stats.reservedBytes = nodePool.GetCapacity() + childPool.GetCapacity() + entryPool.GetCapacity();
+
+		for (NodeIterator it(root); !it.IsEnd(); ++it)
+		{
+			const Node* node = *it;
+			const size_t depth = static_cast<size_t>(it.GetDepth());
+			const size_t objects = node->count;
+
+			size_t bucket = 0;
+			while ((size_t(1) << bucket) <= objects)
+				bucket++;
+
+			if (stats.nodesPerLevel.size() <= depth)
+				stats.nodesPerLevel.resize(depth + 1, 0);
+			if (stats.objectsPerNode.size() <= bucket)
+				stats.objectsPerNode.resize(bucket + 1, 0);
+
+			stats.nodesPerLevel[depth]++;
+			stats.objectsPerNode[bucket]++;
+			stats.nodeCount++;
+			stats.objectCount += objects;
+			stats.interiorObjects += node->IsLeaf() ? 0 : objects;
+			stats.memoryBytes += sizeof(Node) + objects * sizeof(OctreeData<T>) + (node->IsLeaf() ? 0 : 8 * sizeof(Node*));
+		}
+		return stats;
+	}
+
+	// Totals of every query since the last ResetQueryStats(). A query counts into its own
+	// counters and adds them to the totals once, when it ends, with relaxed atomics: const
+	// queries may run on any number of threads, and a snapshot taken meanwhile holds only
+	// the queries that have finished. Resetting while queries run may keep part of them.
+	inline OctreeQueryStats GetQueryStats() const
+	{
+		OctreeQueryStats stats;
+		stats.queries = queryStats.queries.load(std::memory_order_relaxed);
+		stats.nodesVisited = queryStats.nodesVisited.load(std::memory_order_relaxed);
+		stats.aabbTests = queryStats.aabbTests.load(std::memory_order_relaxed);
+		stats.hits = queryStats.hits.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+	inline void ResetQueryStats()
+	{
+		queryStats.queries.store(0, std::memory_order_relaxed);
+		queryStats.nodesVisited.store(0, std::memory_order_relaxed);
+		queryStats.aabbTests.store(0, std::memory_order_relaxed);
+		queryStats.hits.store(0, std::memory_order_relaxed);
+	}
+#endif
+
 private:
 
-	inline void Insert(Node* node, T* object, int depth)
+	static inline OctreeConfig Sanitize(OctreeConfig config)
+	{
+		if (OCTREE_DYNAMIC_DEPTH != MAX_DEPTH)
+			config.maxDepth = MAX_DEPTH;
+		else if (config.maxDepth > OCTREE_MAX_DYNAMIC_DEPTH)
+			config.maxDepth = OCTREE_MAX_DYNAMIC_DEPTH;
+		else if (config.maxDepth < 0)
+			config.maxDepth = 0;
+
+		if (config.looseness < 1.0f || config.quantised)
+			config.looseness = 1.0f;
+		return config;
+	}
+
+	inline bool CanSplit(const Node* node, int depth) const
+	{
+		return depth < GetMaxDepth() && node->bound.halfSize >= config.minNodeSize;
+	}
+
+	// an object box and, in quantised mode, its grid coordinates
+	struct ObjectKey
+	{
+		Box		box;
+		ivec3	gmin;
+		ivec3	gmax;
+	};
+
+	inline ObjectKey MakeKey(const Box& box) const
+	{
+		ObjectKey key{ box, ivec3{ 0, 0, 0 }, ivec3{ 0, 0, 0 } };
+		if (config.quantised)
+			Quantise(box, key.gmin, key.gmax);
+		return key;
+	}
+
+	// child of node at depth that takes the object, -1 if it has to stay in node.
+	// Quantised: the grid bit of that level selects the child and both corners must agree on it.
+	// Otherwise: the side of the node centre the box centre lies on selects the child, whose
+	// loose bound must contain the box.
+	inline int ChildIndex(const Node* node, int depth, const ObjectKey& key) const
+	{
+		if (config.quantised)
+		{
+			const int shift = GetMaxDepth() - 1 - depth;
+			if (0 != (((key.gmin.x ^ key.gmax.x) | (key.gmin.y ^ key.gmax.y) | (key.gmin.z ^ key.gmax.z)) >> shift))
+				return -1;
+
+			return ((key.gmin.x >> shift) & 1) | (((key.gmin.y >> shift) & 1) << 1) | (((key.gmin.z >> shift) & 1) << 2);
+		}
+
+		const Box& obox = key.box;
+		const Vec& c = node->bound.center;
+		Vec o = (obox.min + obox.max) * Scalar(0.5);
+
+		size_t idx = (c.x <= o.x ? 1 : 0) | (c.y <= o.y ? 2 : 0) | (c.z <= o.z ? 4 : 0);
+
+		Bound childBound = node->GetChildBound(idx);
+		if (!Box(childBound.center, childBound.halfSize * static_cast<Scalar>(config.looseness)).Contains(obox))
+			return -1;
+		return static_cast<int>(idx);
+	}
+
+	inline Node* GetOrCreateChild(Node* node, size_t idx)
+	{
+		Node* child = node->GetChild(idx);
+		if (nullptr == child)
+		{
+			Bound childBound = node->GetChildBound(idx);
+			if (node->IsLeaf())
+				node->children = NewChildren();
+
+			child = NewNode(childBound.center, childBound.halfSize);
+			child->parent = node;
+			node->SetChild(idx, child);
+		}
+		return child;
+	}
+
+	inline void Insert(OctreeData<T>* entry)
+	{
+		const ObjectKey key = MakeKey(entry->GetAABB());
+
+		Node* node = root;
+		int depth = 0;
+		for (; CanSplit(node, depth); depth++)
+		{
+			// A leaf with room in its bucket keeps the object, a full one is split first. A settled
+			// leaf was split before and kept every object, as none fits a child; those never move
+			// down, so splitting it again would only relink them.
+			if (0 != config.bucketSize && node->IsLeaf())
+			{
+				if (node->count < config.bucketSize)
+					break;
+				if (!node->settled)
+					Split(node, depth);
+			}
+
+			int idx = ChildIndex(node, depth, key);
+			if (idx < 0)
+				break;
+			node = GetOrCreateChild(node, idx);
+		}
+
+		node->Insert(entry);
+		Touch(node);
+
+		if (!std::is_same<A, NoAggregate>::value)
+		{
+			auto value = A::FromObject(*entry->object);
+			for (auto p = node; nullptr != p; p = p->parent)
+				p->aggregate = A::Combine(p->aggregate, value);
+		}
+	}
+
+	// pushes the objects of a full leaf down into its children, keeping those that fit none
+	inline void Split(Node* node, int depth)
 	{
-		const NodeBoundingBox& nbox = node->GetBound();
-		const AABB& obox = object->GetAABB();
+		OctreeData<T>* entries = node->objects;
+		node->objects = nullptr;
+		node->count = 0;
 
-		if (AABB(nbox).Contains(obox))
+		while (nullptr != entries)
 		{
-			if (depth > 0)
+			auto n = entries;
+			entries = n->next;
+
+			int idx = ChildIndex(node, depth, MakeKey(n->GetAABB()));
+			Node* target = idx < 0 ? node : GetOrCreateChild(node, idx);
+			target->Insert(n);
+		}
+		node->settled = node->IsLeaf();
+
+		if (!std::is_same<A, NoAggregate>::value)
+		{
+			for (size_t i = 0; i < 8; i++)
 			{
-				float halfSize = node->bound.halfSize * 0.5f;
+				if (nullptr != node->GetChild(i))
+					node->GetChild(i)->UpdateAggregate();
+			}
+			node->UpdateAggregate();
+		}
+	}
+
+	inline Node* NewNode(const Vec& center, Scalar halfSize)
+	{
+		Node* node = new (nodePool.Allocate()) Node(center, halfSize);
+		node->version = version;
+		node->created = version;
+		return node;
+	}
+
+	inline void NextVersion()
+	{
+		version++;
+		if (!config.history)
+			historyStart = version;
+	}
+
+	// structure replaced wholesale, every follower has to start over
+	inline void ResetHistory()
+	{
+		NextVersion();
+		historyStart = version;
+		removals.clear();
+		prunedNodes.clear();
+	}
+
+	// stamps node and its ancestors with the current version
+	inline void Touch(Node* node)
+	{
+		for (; nullptr != node; node = node->parent)
+			node->version = version;
+	}
+
+	inline void FreeNode(Node* node)
+	{
+		node->~Node();
+		nodePool.Free(node);
+	}
+
+	inline Node** NewChildren()
+	{
+		Node** children = static_cast<Node**>(childPool.Allocate());
+		for (size_t i = 0; i < 8; i++)
+			children[i] = nullptr;
+		return children;
+	}
+
+	// drops the whole node structure at once, object entries are left to the caller
+	inline void ReleaseNodes()
+	{
+		if (!std::is_trivially_destructible<Node>::value)
+		{
+			std::vector<Node*> nodes;
+			for (const Node* n : Nodes())
+				nodes.push_back(const_cast<Node*>(n));
+			for (Node* n : nodes)
+				n->~Node();
+		}
+
+		nodePool.Reset();
+		childPool.Reset();
+		root = nullptr;
+	}
+
+	// frees empty leaves upwards from node and refreshes the aggregates along the parent chain
+	inline void Prune(Node* node)
+	{
+		while (nullptr != node)
+		{
+			Node* parent = node->parent;
+
+			if (nullptr != parent && nullptr == node->objects && node->IsLeaf())
+			{
+				if (config.history)
+					prunedNodes.push_back(PrunedNode{ node->bound, version });
+
+				parent->children[node->index] = nullptr;
+				FreeNode(node);
+
+				bool empty = true;
 				for (size_t i = 0; i < 8; i++)
+					empty = empty && nullptr == parent->children[i];
+				if (empty)
 				{
-					NodeBoundingBox childBound = node->GetChildBound(i);
-					if (AABB(childBound).Contains(obox))
-					{
-						Node* child = node->GetChild(i);
-						if (nullptr == child)
-						{
-							child = new Node(childBound.center, childBound.halfSize);
-							child->parent = node;
-							node->SetChild(i, child);
-						}
-						Insert(child, object, depth - 1);
-						return;
-					}
+					childPool.Free(parent->children);
+					parent->children = nullptr;
 				}
 			}
+			else
+			{
+				if (std::is_same<A, NoAggregate>::value)
+					break;
+				node->UpdateAggregate();
+			}
 
-			node->Insert(object);
+			node = parent;
 		}
-		else
+	}
+
+#ifdef OCTREE_ENABLE_STATS
+	typedef OctreeQueryStats QueryCounters;
+
+	struct SharedQueryStats
+	{
+		std::atomic<size_t>	queries{ 0 };
+		std::atomic<size_t>	nodesVisited{ 0 };
+		std::atomic<size_t>	aabbTests{ 0 };
+		std::atomic<size_t>	hits{ 0 };
+	};
+
+	inline void MergeQueryStats(const QueryCounters& counters) const
+	{
+		queryStats.queries.fetch_add(counters.queries, std::memory_order_relaxed);
+		queryStats.nodesVisited.fetch_add(counters.nodesVisited, std::memory_order_relaxed);
+		queryStats.aabbTests.fetch_add(counters.aabbTests, std::memory_order_relaxed);
+		queryStats.hits.fetch_add(counters.hits, std::memory_order_relaxed);
+	}
+#else
+	struct QueryCounters { };
+#endif
+
+	template<typename P, typename F>
+	inline void Query(const Node* node, const Box& box, P& filter, F& func, QueryCounters& counters) const
+	{
+		(void)counters;
+
+		// every level pops one node and pushes at most eight
+		const Node* stack[7 * STACK_DEPTH + 1];
+		int top = 0;
+		stack[top++] = node;
+
+		while (top > 0)
 		{
-			// TODO expand tree
-		}
+			node = stack[--top];
+
+#ifdef OCTREE_ENABLE_STATS
+			counters.nodesVisited++;
+			counters.aabbTests++;
+#endif
+
+			if (!LooseBound(node).Intersects(box) ||
+				!OctreeAggregateBounds<A, Box>::Intersects(node->aggregate, box) ||
+				!filter(node->aggregate))
+				continue;
+
+			for (auto p = node->objects; nullptr != p; p = p->next)
+			{
+#ifdef OCTREE_ENABLE_STATS
+				counters.aabbTests++;
+#endif
+				if (p->GetAABB().Intersects(box) && filter(A::FromObject(*p->object)))
+				{
+#ifdef OCTREE_ENABLE_STATS
+					counters.hits++;
+#endif
+					func(p->object);
+				}
+			}
 
+			if (!node->IsLeaf())
+			{
+				for (size_t i = 8; i-- > 0;)
+				{
+					auto child = node->GetChild(i);
+					if (nullptr != child)
+						stack[top++] = child;
+				}
+			}
+		}
 	}
 
 private:
-	Node*		root;
+	Node*			root;
+	OctreeConfig	config;
+
+	OctreePool<Node>			nodePool;
+	OctreePool<Node*[8]>		childPool;
+	OctreePool<OctreeData<T>>	entryPool;
+
+	struct Removal
+	{
+		uint64_t	id;
+		uint64_t	version;
+	};
+
+	struct PrunedNode
+	{
+		Bound		bound;
+		uint64_t	version;
+	};
+
+	uint64_t				version;
+	uint64_t				historyStart;	// oldest version the logs cover
+	std::vector<Removal>	removals;
+	std::vector<PrunedNode>	prunedNodes;
+
+#ifdef OCTREE_ENABLE_STATS
+	mutable SharedQueryStats	queryStats;	// see GetQueryStats()
+#endif
 };
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <iterator>
+
+template<typename T>
+struct OctreeData;
+
+// Pre-order depth first traversal over the nodes of a tree no deeper than MAX_DEPTH.
+// Uses a fixed size explicit stack of one frame per level, so it neither recurses nor allocates.
+template<typename Node, int MAX_DEPTH>
+class OctreeDepthFirstIterator
+{
+public:
+	typedef std::forward_iterator_tag	iterator_category;
+	typedef const Node*					value_type;
+	typedef std::ptrdiff_t				difference_type;
+	typedef const Node* const*			pointer;
+	typedef const Node* const&			reference;
+
+	inline OctreeDepthFirstIterator() : top(0) { }
+
+	inline explicit OctreeDepthFirstIterator(const Node* root)
+		: top(0)
+	{
+		if (nullptr != root)
+			stack[top++] = Frame{ root, 0 };
+	}
+
+	inline reference operator * () const { return stack[top - 1].node; }
+
+	inline pointer operator -> () const { return &stack[top - 1].node; }
+
+	// depth of the current node, the root is at 0
+	inline int GetDepth() const { return top - 1; }
+
+	inline bool IsEnd() const { return 0 == top; }
+
+	inline OctreeDepthFirstIterator& operator ++ ()
+	{
+		while (top > 0)
+		{
+			Frame& frame = stack[top - 1];
+			while (frame.next < 8)
+			{
+				const Node* child = frame.node->GetChild(frame.next++);
+				if (nullptr != child)
+				{
+					stack[top++] = Frame{ child, 0 };
+					return *this;
+				}
+			}
+			top--;
+		}
+		return *this;
+	}
+
+	inline OctreeDepthFirstIterator operator ++ (int) { auto it = *this; ++(*this); return it; }
+
+	inline bool operator == (const OctreeDepthFirstIterator& other) const
+	{
+		return top == other.top && (0 == top || stack[top - 1].node == other.stack[top - 1].node);
+	}
+
+	inline bool operator != (const OctreeDepthFirstIterator& other) const { return !(*this == other); }
+
+private:
+	struct Frame
+	{
+		const Node*	node;
+		size_t		next;
+	};
+
+	Frame	stack[MAX_DEPTH + 1];
+	int		top;
+};
+
+// Level order traversal over the nodes of a tree.
+template<typename Node>
+class OctreeBreadthFirstIterator
+{
+public:
+	typedef std::forward_iterator_tag	iterator_category;
+	typedef const Node*					value_type;
+	typedef std::ptrdiff_t				difference_type;
+	typedef const Node* const*			pointer;
+	typedef const Node* const&			reference;
+
+	inline OctreeBreadthFirstIterator() { }
+
+	inline explicit OctreeBreadthFirstIterator(const Node* root)
+	{
+		if (nullptr != root)
+			queue.push_back(root);
+	}
+
+	inline reference operator * () const { return queue.front(); }
+
+	inline pointer operator -> () const { return &queue.front(); }
+
+	inline OctreeBreadthFirstIterator& operator ++ ()
+	{
+		const Node* node = queue.front();
+		queue.pop_front();
+
+		for (size_t i = 0; i < 8; i++)
+		{
+			const Node* child = node->GetChild(i);
+			if (nullptr != child)
+				queue.push_back(child);
+		}
+		return *this;
+	}
+
+	inline OctreeBreadthFirstIterator operator ++ (int) { auto it = *this; ++(*this); return it; }
+
+	inline bool operator == (const OctreeBreadthFirstIterator& other) const
+	{
+		return queue.size() == other.queue.size() && (queue.empty() || queue.front() == other.queue.front());
+	}
+
+	inline bool operator != (const OctreeBreadthFirstIterator& other) const { return !(*this == other); }
+
+private:
+	std::deque<const Node*>	queue;
+};
+
+// Visits every object of the tree, node by node in depth first order.
+template<typename T, typename Node, int MAX_DEPTH>
+class OctreeObjectIterator
+{
+public:
+	typedef std::forward_iterator_tag	iterator_category;
+	typedef T*							value_type;
+	typedef std::ptrdiff_t				difference_type;
+	typedef T* const*					pointer;
+	typedef T* const&					reference;
+
+	inline OctreeObjectIterator() : data(nullptr) { }
+
+	inline explicit OctreeObjectIterator(const Node* root)
+		: nodes(root), data(nullptr)
+	{
+		Skip();
+	}
+
+	inline reference operator * () const { return data->object; }
+
+	inline pointer operator -> () const { return &data->object; }
+
+	inline OctreeObjectIterator& operator ++ ()
+	{
+		data = data->next;
+		if (nullptr == data)
+		{
+			++nodes;
+			Skip();
+		}
+		return *this;
+	}
+
+	inline OctreeObjectIterator operator ++ (int) { auto it = *this; ++(*this); return it; }
+
+	inline bool operator == (const OctreeObjectIterator& other) const { return data == other.data; }
+
+	inline bool operator != (const OctreeObjectIterator& other) const { return data != other.data; }
+
+private:
+	// moves to the first object at or after the current node
+	inline void Skip()
+	{
+		for (; !nodes.IsEnd(); ++nodes)
+		{
+			data = (*nodes)->objects;
+			if (nullptr != data)
+				return;
+		}
+		data = nullptr;
+	}
+
+	OctreeDepthFirstIterator<Node, MAX_DEPTH>	nodes;
+	const OctreeData<T>*						data;
+};
+
+template<typename I>
+struct OctreeRange
+{
+	I	first;
+	I	last;
+
+	inline I begin() const { return first; }
+	inline I end() const { return last; }
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cmath>
+#include <limits>
+
+#include "Vector3.h"
+
+// Error metrics for Octree::SelectCut. Both measure the node edge length against the
+// distance from the eye to the nearest point of the node bound, a node around the eye
+// has an unbounded error and is always refined.
+
+// distance from eye to the closest point of a node bound, 0 inside it
+template<typename S, typename Bound>
+inline S OctreeBoundDistance(const Vector3<S>& eye, const Bound& bound)
+{
+	auto axis = [&bound](S e, S c)
+	{
+		S d = std::abs(e - c) - bound.halfSize;
+		return d > S(0) ? d : S(0);
+	};
+
+	Vector3<S> d{ axis(eye.x, bound.center.x), axis(eye.y, bound.center.y), axis(eye.z, bound.center.z) };
+	return std::sqrt(dot(d, d));
+}
+
+// node size over distance, the tangent of the angle the node spans from eye
+template<typename S>
+struct TOctreeDistanceError
+{
+	Vector3<S>	eye;
+
+	template<typename Node>
+	inline S operator () (const Node* node) const
+	{
+		const S distance = OctreeBoundDistance(eye, node->bound);
+		if (S(0) == distance)
+			return std::numeric_limits<S>::max();
+		return node->bound.halfSize * 2 / distance;
+	}
+};
+
+// node size in pixels on a perspective view with a vertical field of view fovY over
+// viewportHeight pixels, as set up by Renderer::SetCameraLookTo with a fovY of pi / 2
+template<typename S>
+struct TOctreeScreenSpaceError
+{
+	Vector3<S>	eye;
+	S			pixelsPerRadian;	// viewportHeight / (2 tan(fovY / 2))
+
+	inline TOctreeScreenSpaceError(const Vector3<S>& eye, S fovY, S viewportHeight)
+		: eye(eye), pixelsPerRadian(viewportHeight / (2 * std::tan(fovY / 2))) { }
+
+	template<typename Node>
+	inline S operator () (const Node* node) const
+	{
+		const S distance = OctreeBoundDistance(eye, node->bound);
+		if (S(0) == distance)
+			return std::numeric_limits<S>::max();
+		return node->bound.halfSize * 2 * pixelsPerRadian / distance;
+	}
+};
+
+typedef TOctreeDistanceError<float>		OctreeDistanceError;
+typedef TOctreeScreenSpaceError<float>	OctreeScreenSpaceError;
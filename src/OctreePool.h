@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// Block allocator for fixed size records of type U. Slots are carved out of blocks of
+// BLOCK_SIZE records; Free() puts a slot on a free list for the next Allocate(), and
+// Reset() hands every slot out again from the first block without returning memory.
+// It only manages storage, callers construct and destroy the records themselves.
+template<typename U, size_t BLOCK_SIZE = 256>
+class OctreePool
+{
+public:
+
+	inline OctreePool() : freeList(nullptr), current(0), used(BLOCK_SIZE) { }
+
+	OctreePool(const OctreePool&) = delete;
+	OctreePool& operator = (const OctreePool&) = delete;
+
+	inline ~OctreePool()
+	{
+		for (Slot* block : blocks)
+			::operator delete(block, std::align_val_t(alignof(Slot)));
+	}
+
+	inline void* Allocate()
+	{
+		if (nullptr != freeList)
+		{
+			Slot* slot = freeList;
+			freeList = slot->next;
+			return slot;
+		}
+
+		if (BLOCK_SIZE == used)
+		{
+			if (!blocks.empty() && current + 1 < blocks.size())
+				current++;
+			else
+			{
+				// aligned for U, which may ask for more than the default new alignment
+				blocks.push_back(static_cast<Slot*>(::operator new(sizeof(Slot) * BLOCK_SIZE, std::align_val_t(alignof(Slot)))));
+				current = blocks.size() - 1;
+			}
+			used = 0;
+		}
+		return &blocks[current][used++];
+	}
+
+	inline void Free(void* p)
+	{
+		Slot* slot = static_cast<Slot*>(p);
+		slot->next = freeList;
+		freeList = slot;
+	}
+
+	// forgets every allocation, the records must already be destroyed or trivially destructible
+	inline void Reset()
+	{
+		freeList = nullptr;
+		current = 0;
+		used = blocks.empty() ? BLOCK_SIZE : 0;
+	}
+
+	// bytes of storage held, whether handed out or not
+	inline size_t GetCapacity() const { return blocks.size() * BLOCK_SIZE * sizeof(Slot); }
+
+private:
+	union Slot
+	{
+		Slot*						next;
+		alignas(U) unsigned char	storage[sizeof(U)];
+	};
+
+	std::vector<Slot*>	blocks;
+	Slot*				freeList;
+	size_t				current;	// block the next fresh slot comes from
+	size_t				used;		// slots taken from blocks[current]
+};
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "Octree.h"
+
+// object of a follower tree, known by the id and box the leader sent
+template<typename S>
+struct TOctreeReplicaObject
+{
+	uint64_t	id;
+	TAABB<S>	box;
+
+	inline const TAABB<S>& GetAABB() const { return box; }
+	inline uint64_t GetID() const { return id; }
+};
+
+// Read only copy of a leader Octree kept up to date by applying its deltas in order.
+// Nodes follow from the objects; with the leader's bounds and config and no bucketSize the
+// replica ends up with the same nodes, otherwise splits depend on the order of inserts.
+template<typename S, int MAX_DEPTH, typename A = NoAggregate>
+class OctreeReplica
+{
+public:
+
+	typedef TOctreeReplicaObject<S> Object;
+	typedef Octree<Object, MAX_DEPTH, A> Tree;
+
+	inline OctreeReplica(const Vector3<S>& center, S halfSize, const OctreeConfig& config = OctreeConfig())
+		: tree(center, halfSize, config), version(0) { }
+
+	// false when delta neither starts at the replica version nor resets it, nothing is applied
+	inline bool Apply(const TOctreeDelta<S>& delta)
+	{
+		if (!delta.reset && delta.since != version)
+			return false;
+
+		if (delta.reset)
+		{
+			tree.Clear();
+			objects.clear();
+		}
+
+		for (uint64_t id : delta.removed)
+		{
+			auto it = objects.find(id);
+			if (it == objects.end())
+				continue;
+
+			tree.Remove(it->second.get());
+			objects.erase(it);
+		}
+
+		for (auto& object : delta.moved)
+			Upsert(object);
+		for (auto& object : delta.added)
+			Upsert(object);
+
+		version = delta.version;
+		return true;
+	}
+
+	// leader version the replica reflects, the one to ask the next delta for
+	inline uint64_t GetVersion() const { return version; }
+
+	inline const Tree& GetTree() const { return tree; }
+
+	inline const Object* Find(uint64_t id) const
+	{
+		auto it = objects.find(id);
+		return it == objects.end() ? nullptr : it->second.get();
+	}
+
+	inline size_t GetCount() const { return objects.size(); }
+
+private:
+
+	inline void Upsert(const typename TOctreeDelta<S>::Object& object)
+	{
+		std::unique_ptr<Object>& slot = objects[object.id];
+		if (nullptr == slot)
+			slot.reset(new Object{ object.id, object.box });
+		else
+		{
+			tree.Remove(slot.get());
+			slot->box = object.box;
+		}
+		tree.Insert(slot.get());
+	}
+
+	Tree													tree;
+	std::unordered_map<uint64_t, std::unique_ptr<Object>>	objects;
+	uint64_t												version;
+};
+
+namespace OctreeDeltaFormat
+{
+	const uint32_t magic = 0x4454434f;		// "OCTD"
+
+	template<typename V>
+	inline void Put(std::vector<uint8_t>& out, V value)
+	{
+		static_assert(std::is_arithmetic<V>::value, "only plain numbers are written");
+		const size_t at = out.size();
+		out.resize(at + sizeof(V));
+		std::memcpy(&out[at], &value, sizeof(V));
+	}
+
+	template<typename V>
+	inline bool Get(const uint8_t*& data, const uint8_t* end, V& value)
+	{
+		if (static_cast<size_t>(end - data) < sizeof(V))
+			return false;
+		std::memcpy(&value, data, sizeof(V));
+		data += sizeof(V);
+		return true;
+	}
+
+	template<typename S>
+	inline void PutBox(std::vector<uint8_t>& out, const TAABB<S>& box)
+	{
+		Put(out, box.min.x); Put(out, box.min.y); Put(out, box.min.z);
+		Put(out, box.max.x); Put(out, box.max.y); Put(out, box.max.z);
+	}
+
+	template<typename S>
+	inline bool GetBox(const uint8_t*& data, const uint8_t* end, TAABB<S>& box)
+	{
+		return
+			Get(data, end, box.min.x) && Get(data, end, box.min.y) && Get(data, end, box.min.z) &&
+			Get(data, end, box.max.x) && Get(data, end, box.max.y) && Get(data, end, box.max.z);
+	}
+
+	template<typename S>
+	inline void PutBound(std::vector<uint8_t>& out, const TNodeBoundingBox<S>& bound)
+	{
+		Put(out, bound.center.x); Put(out, bound.center.y); Put(out, bound.center.z);
+		Put(out, bound.halfSize);
+	}
+
+	template<typename S>
+	inline bool GetBound(const uint8_t*& data, const uint8_t* end, TNodeBoundingBox<S>& bound)
+	{
+		return
+			Get(data, end, bound.center.x) && Get(data, end, bound.center.y) && Get(data, end, bound.center.z) &&
+			Get(data, end, bound.halfSize);
+	}
+
+	// a count followed by that many records, refusing counts the remaining bytes cannot hold
+	template<typename R, typename F>
+	inline bool GetRecords(const uint8_t*& data, const uint8_t* end, size_t recordSize, std::vector<R>& records, F&& read)
+	{
+		uint32_t count;
+		if (!Get(data, end, count) || static_cast<size_t>(end - data) / recordSize < count)
+			return false;
+
+		records.resize(count);
+		for (auto& record : records)
+		{
+			if (!read(record))
+				return false;
+		}
+		return true;
+	}
+}
+
+// Appends delta to out in host byte order: a header with the scalar size, the versions and
+// the reset flag, then each list as a count and its records.
+template<typename S>
+inline void OctreeWriteDelta(const TOctreeDelta<S>& delta, std::vector<uint8_t>& out)
+{
+	using namespace OctreeDeltaFormat;
+
+	Put(out, magic);
+	Put(out, static_cast<uint8_t>(sizeof(S)));
+	Put(out, static_cast<uint8_t>(delta.reset ? 1 : 0));
+	Put(out, delta.since);
+	Put(out, delta.version);
+
+	Put(out, static_cast<uint32_t>(delta.added.size()));
+	for (auto& object : delta.added)
+	{
+		Put(out, object.id);
+		PutBox(out, object.box);
+	}
+
+	Put(out, static_cast<uint32_t>(delta.moved.size()));
+	for (auto& object : delta.moved)
+	{
+		Put(out, object.id);
+		PutBox(out, object.box);
+	}
+
+	Put(out, static_cast<uint32_t>(delta.removed.size()));
+	for (uint64_t id : delta.removed)
+		Put(out, id);
+
+	Put(out, static_cast<uint32_t>(delta.createdNodes.size()));
+	for (auto& bound : delta.createdNodes)
+		PutBound(out, bound);
+
+	Put(out, static_cast<uint32_t>(delta.prunedNodes.size()));
+	for (auto& bound : delta.prunedNodes)
+		PutBound(out, bound);
+}
+
+// false for a truncated or foreign message, or one written with another scalar type
+template<typename S>
+inline bool OctreeReadDelta(const uint8_t* data, size_t size, TOctreeDelta<S>& delta)
+{
+	using namespace OctreeDeltaFormat;
+
+	const uint8_t* end = data + size;
+	uint32_t tag;
+	uint8_t scalarSize, reset;
+	if (!Get(data, end, tag) || magic != tag ||
+		!Get(data, end, scalarSize) || sizeof(S) != scalarSize ||
+		!Get(data, end, reset) ||
+		!Get(data, end, delta.since) ||
+		!Get(data, end, delta.version))
+		return false;
+	delta.reset = 0 != reset;
+
+	typedef typename TOctreeDelta<S>::Object Object;
+	auto object = [&](Object& o) { return Get(data, end, o.id) && GetBox(data, end, o.box); };
+	auto bound = [&](TNodeBoundingBox<S>& b) { return GetBound(data, end, b); };
+
+	return
+		GetRecords(data, end, sizeof(uint64_t) + 6 * sizeof(S), delta.added, object) &&
+		GetRecords(data, end, sizeof(uint64_t) + 6 * sizeof(S), delta.moved, object) &&
+		GetRecords(data, end, sizeof(uint64_t), delta.removed, [&](uint64_t& id) { return Get(data, end, id); }) &&
+		GetRecords(data, end, 4 * sizeof(S), delta.createdNodes, bound) &&
+		GetRecords(data, end, 4 * sizeof(S), delta.prunedNodes, bound);
+}
+
+// in process stand in for the channel between a leader and a follower, delivering
+// messages in the order they were sent; safe to use from two threads
+class OctreeLoopbackTransport
+{
+public:
+
+	inline OctreeLoopbackTransport() : bytesSent(0) { }
+
+	inline void Send(std::vector<uint8_t> message)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		bytesSent += message.size();
+		queue.push_back(std::move(message));
+	}
+
+	// false when nothing is waiting
+	inline bool Receive(std::vector<uint8_t>& message)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (queue.empty())
+			return false;
+
+		message = std::move(queue.front());
+		queue.pop_front();
+		return true;
+	}
+
+	inline size_t GetBytesSent() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return bytesSent;
+	}
+
+private:
+	mutable std::mutex					mutex;
+	std::deque<std::vector<uint8_t>>	queue;
+	size_t								bytesSent;
+};
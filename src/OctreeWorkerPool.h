@@ -0,0 +1,152 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work stealing task scheduler for splitting one traversal over several threads.
+// Every worker owns a deque: tasks it spawns go to the back and are taken from the back
+// again, idle workers steal from the front of the others, so stolen work tends to be the
+// largest subtrees. The thread calling Run() takes part as worker 0; Run() is not reentrant
+// and a pool serves one Run() at a time.
+class OctreeWorkerPool
+{
+public:
+	typedef std::function<void(size_t worker)> Task;
+
+	// workers counts the calling thread, 0 uses one per hardware thread
+	inline explicit OctreeWorkerPool(size_t workers = 0)
+		: pending(0), generation(0), stop(false)
+	{
+		if (0 == workers)
+			workers = std::thread::hardware_concurrency();
+		if (0 == workers)
+			workers = 1;
+
+		for (size_t i = 0; i < workers; i++)
+			queues.emplace_back(new Queue());
+
+		for (size_t i = 1; i < workers; i++)
+			threads.emplace_back([this, i]() { WorkerLoop(i); });
+	}
+
+	OctreeWorkerPool(const OctreeWorkerPool&) = delete;
+	OctreeWorkerPool& operator = (const OctreeWorkerPool&) = delete;
+
+	inline ~OctreeWorkerPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		wake.notify_all();
+
+		for (auto& thread : threads)
+			thread.join();
+	}
+
+	inline size_t GetWorkerCount() const { return queues.size(); }
+
+	// runs task and everything it spawns, returning once all of it has finished
+	inline void Run(Task task)
+	{
+		Spawn(0, std::move(task));
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			generation++;
+		}
+		wake.notify_all();
+
+		Work(0);
+	}
+
+	// queues task on worker, to be called from a task running on that worker
+	inline void Spawn(size_t worker, Task task)
+	{
+		pending++;
+		std::lock_guard<std::mutex> lock(queues[worker]->mutex);
+		queues[worker]->tasks.push_back(std::move(task));
+	}
+
+private:
+	struct Queue
+	{
+		std::mutex			mutex;
+		std::deque<Task>	tasks;
+	};
+
+	// newest task of worker, otherwise the oldest one stolen from another worker
+	inline bool Pop(size_t worker, Task& task)
+	{
+		for (size_t i = 0; i < queues.size(); i++)
+		{
+			const size_t victim = (worker + i) % queues.size();
+			Queue& queue = *queues[victim];
+
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (queue.tasks.empty())
+				continue;
+
+			if (victim == worker)
+			{
+				task = std::move(queue.tasks.back());
+				queue.tasks.pop_back();
+			}
+			else
+			{
+				task = std::move(queue.tasks.front());
+				queue.tasks.pop_front();
+			}
+			return true;
+		}
+		return false;
+	}
+
+	inline void Work(size_t worker)
+	{
+		Task task;
+		while (pending > 0)
+		{
+			if (Pop(worker, task))
+			{
+				task(worker);
+				task = nullptr;
+				pending--;
+			}
+			else
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	inline void WorkerLoop(size_t worker)
+	{
+		size_t seen = 0;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&]() { return stop || seen != generation; });
+				if (stop)
+					return;
+				seen = generation;
+			}
+			Work(worker);
+		}
+	}
+
+	std::vector<std::unique_ptr<Queue>>	queues;		// [0] belongs to the thread calling Run()
+	std::vector<std::thread>			threads;
+	std::atomic<size_t>					pending;	// spawned tasks not finished yet
+	std::mutex							mutex;
+	std::condition_variable				wake;
+	size_t								generation;	// bumped by every Run() to wake the workers
+	bool								stop;
+};
@@ -0,0 +1,510 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <list>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "Octree.h"
+
+// Out-of-core octree: levels above PAGE_DEPTH stay in memory, every subtree rooted at
+// PAGE_DEPTH is kept in its own chunk file and paged in by queries through an LRU cache
+// bounded by a byte budget. Objects are stored by value, so T must be trivially copyable
+// and expose GetAABB().
+// A page is always a whole PAGE_DEPTH subtree and is never split, and the page in use is
+// never evicted, so the resident size can exceed the budget by the size of the largest page.
+// Pick PAGE_DEPTH so that the densest region still makes a page that fits the budget.
+template<typename T, int MAX_DEPTH, int PAGE_DEPTH>
+class PagedOctree
+{
+	static_assert(std::is_trivially_copyable<T>::value, "paged objects are written to chunk files as raw bytes");
+	static_assert(0 < PAGE_DEPTH && PAGE_DEPTH <= MAX_DEPTH, "PAGE_DEPTH must be in (0, MAX_DEPTH]");
+
+public:
+
+	// node of the compact subtree rebuilt in memory while a page is resident
+	struct PageNode
+	{
+		NodeBoundingBox	bound;
+		int32_t			children[8];
+		uint32_t		first;
+		uint32_t		count;
+	};
+
+	struct Page
+	{
+		uint32_t				id;
+		NodeBoundingBox			bound;
+		uint64_t				count;
+		size_t					bytes;
+		bool					resident;
+		bool					dirty;
+		bool					built;
+		bool					written;	// chunk file created by this tree
+		std::vector<T>			objects;
+		std::vector<PageNode>	nodes;
+		typename std::list<Page*>::iterator	lru;
+	};
+
+	struct Node
+	{
+		Node*			children[8];
+		Node*			parent;
+		NodeBoundingBox	bound;
+		std::vector<T>	objects;
+		Page*			page;
+	};
+
+	// Chunk files are named chunk_<id>.bin in directory. Files left there by an earlier run are
+	// overwritten, not read, and only the files this tree wrote are removed again; two live
+	// trees must not share a directory.
+	inline PagedOctree(vec3 center, float halfSize, const std::string& directory, size_t budget)
+		:
+		root(NewNode(nullptr, NodeBoundingBox{ center, halfSize })),
+		directory(directory),
+		budget(budget),
+		residentBytes(0),
+		failed(false)
+	{
+
+	}
+
+	PagedOctree(const PagedOctree&) = delete;
+	PagedOctree& operator = (const PagedOctree&) = delete;
+
+	inline ~PagedOctree()
+	{
+		for (auto page : pages)
+		{
+			if (page->written)
+				std::remove(ChunkPath(page->id).c_str());
+			delete page;
+		}
+
+		DeleteNode(root);
+	}
+
+	// Returns false if object is not inside the root bound or its chunk could not be written.
+	// A resident page takes the object in memory, any other page gets it appended to its
+	// chunk file without being loaded.
+	inline bool Insert(const T& object)
+	{
+		Node* node = Locate(object.GetAABB());
+		if (nullptr == node)
+			return false;
+
+		if (nullptr == node->page)
+		{
+			node->objects.push_back(object);
+			return true;
+		}
+		return Add(node->page, &object, 1);
+	}
+
+	// Bulk ingest: groups the objects by page first, so each chunk file is opened once for the
+	// whole batch however the objects are ordered. Returns how many were inserted, skipping
+	// those outside the root bound and those of a chunk that could not be written.
+	inline size_t Insert(const T* objects, size_t count)
+	{
+		std::vector<std::vector<T>> batches;
+		size_t inserted = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			Node* node = Locate(objects[i].GetAABB());
+			if (nullptr == node)
+				continue;
+
+			if (nullptr == node->page)
+			{
+				node->objects.push_back(objects[i]);
+				inserted++;
+				continue;
+			}
+
+			if (batches.size() <= node->page->id)
+				batches.resize(node->page->id + 1);
+			batches[node->page->id].push_back(objects[i]);
+		}
+
+		for (size_t id = 0; id < batches.size(); id++)
+		{
+			if (!batches[id].empty() && Add(pages[id], batches[id].data(), batches[id].size()))
+				inserted += batches[id].size();
+		}
+		return inserted;
+	}
+
+	// Calls func(T*) for every object whose AABB intersects box, paging in chunks as needed, like
+	// Octree::Query. Objects live in the page buffers, so the pointer is only valid during the
+	// call and changes made through it are not written back.
+	template<typename F>
+	inline void Query(const AABB& box, F&& func)
+	{
+		Query(root, box, func);
+	}
+
+	// writes every dirty resident page back to its chunk file
+	inline bool Flush()
+	{
+		for (auto page : lru)
+		{
+			if (page->dirty && !Store(page))
+				return false;
+		}
+		return true;
+	}
+
+	inline void SetBudget(size_t bytes) { budget = bytes; Trim(nullptr); }
+
+	inline size_t GetBudget() const { return budget; }
+
+	inline size_t GetResidentBytes() const { return residentBytes; }
+
+	inline size_t GetResidentPageCount() const { return lru.size(); }
+
+	inline size_t GetPageCount() const { return pages.size(); }
+
+	inline const Node* GetRoot() const { return root; }
+
+	inline operator bool() const { return !failed; }
+
+private:
+
+	static inline NodeBoundingBox ChildBound(const NodeBoundingBox& bound, size_t idx)
+	{
+		vec3 d{ (idx & 1) - 0.5f, ((idx >> 1) & 1) - 0.5f, ((idx >> 2 & 1)) - 0.5f };
+		return NodeBoundingBox{ bound.center + d * bound.halfSize, bound.halfSize * 0.5f };
+	}
+
+	static inline int ChildIndex(const NodeBoundingBox& bound, const AABB& obox)
+	{
+		for (size_t i = 0; i < 8; i++)
+		{
+			if (AABB(ChildBound(bound, i)).Contains(obox))
+				return static_cast<int>(i);
+		}
+		return -1;
+	}
+
+	// node above or at PAGE_DEPTH that takes box, created on the way; nullptr outside the root
+	inline Node* Locate(const AABB& obox)
+	{
+		Node* node = root;
+		if (!AABB(node->bound).Contains(obox))
+			return nullptr;
+
+		for (int depth = 0; depth < PAGE_DEPTH; depth++)
+		{
+			int idx = ChildIndex(node->bound, obox);
+			if (idx < 0)
+				break;
+
+			if (nullptr == node->children[idx])
+				node->children[idx] = NewNode(node, ChildBound(node->bound, idx));
+
+			node = node->children[idx];
+		}
+		return node;
+	}
+
+	inline bool Add(Page* page, const T* objects, size_t count)
+	{
+		if (!page->resident)
+		{
+			if (!Append(page, objects, count))
+			{
+				failed = true;
+				return false;
+			}
+			page->count += count;
+			return true;
+		}
+
+		lru.splice(lru.begin(), lru, page->lru);
+		page->objects.insert(page->objects.end(), objects, objects + count);
+		page->count += count;
+		page->dirty = true;
+		page->built = false;
+		page->nodes.clear();
+
+		Account(page);
+		Trim(page);
+		return true;
+	}
+
+	inline Node* NewNode(Node* parent, const NodeBoundingBox& bound)
+	{
+		Node* node = new Node{ { nullptr }, parent, bound, std::vector<T>(), nullptr };
+
+		int depth = 0;
+		for (auto p = parent; nullptr != p; p = p->parent)
+			depth++;
+
+		if (PAGE_DEPTH == depth)
+		{
+			Page* page = new Page();
+			page->id = static_cast<uint32_t>(pages.size());
+			page->bound = bound;
+			page->count = 0;
+			page->bytes = 0;
+			page->resident = false;
+			page->dirty = false;
+			page->built = false;
+			page->written = false;
+			pages.push_back(page);
+
+			node->page = page;
+		}
+
+		return node;
+	}
+
+	static inline void DeleteNode(Node* node)
+	{
+		for (auto child : node->children)
+		{
+			if (nullptr != child)
+				DeleteNode(child);
+		}
+		delete node;
+	}
+
+	inline std::string ChunkPath(uint32_t id) const
+	{
+		return directory + "/chunk_" + std::to_string(id) + ".bin";
+	}
+
+	template<typename F>
+	inline void Query(Node* node, const AABB& box, F& func)
+	{
+		if (!AABB(node->bound).Intersects(box))
+			return;
+
+		for (auto& object : node->objects)
+		{
+			if (object.GetAABB().Intersects(box))
+				func(&object);
+		}
+
+		if (nullptr != node->page)
+		{
+			QueryPage(node->page, box, func);
+			return;
+		}
+
+		for (auto child : node->children)
+		{
+			if (nullptr != child)
+				Query(child, box, func);
+		}
+	}
+
+	template<typename F>
+	inline void QueryPage(Page* page, const AABB& box, F& func)
+	{
+		if (0 == page->count || !Acquire(page))
+			return;
+
+		if (!page->built)
+			Build(page);
+
+		int32_t stack[8 * (MAX_DEPTH - PAGE_DEPTH) + 1];
+		int top = 0;
+		stack[top++] = 0;
+
+		while (top > 0)
+		{
+			const PageNode& n = page->nodes[stack[--top]];
+			if (!AABB(n.bound).Intersects(box))
+				continue;
+
+			for (uint32_t i = n.first; i < n.first + n.count; i++)
+			{
+				if (page->objects[i].GetAABB().Intersects(box))
+					func(&page->objects[i]);
+			}
+
+			for (auto child : n.children)
+			{
+				if (child >= 0)
+					stack[top++] = child;
+			}
+		}
+	}
+
+	// lays the page objects out so that every compact node owns a contiguous range
+	inline void Build(Page* page)
+	{
+		auto& nodes = page->nodes;
+		nodes.clear();
+		nodes.push_back(PageNode{ page->bound, { -1, -1, -1, -1, -1, -1, -1, -1 }, 0, 0 });
+
+		std::vector<uint32_t> owner(page->objects.size());
+		for (size_t i = 0; i < page->objects.size(); i++)
+		{
+			const AABB& obox = page->objects[i].GetAABB();
+
+			int32_t n = 0;
+			for (int depth = PAGE_DEPTH; depth < MAX_DEPTH; depth++)
+			{
+				int idx = ChildIndex(nodes[n].bound, obox);
+				if (idx < 0)
+					break;
+
+				if (nodes[n].children[idx] < 0)
+				{
+					nodes[n].children[idx] = static_cast<int32_t>(nodes.size());
+					nodes.push_back(PageNode{ ChildBound(nodes[n].bound, idx), { -1, -1, -1, -1, -1, -1, -1, -1 }, 0, 0 });
+				}
+				n = nodes[n].children[idx];
+			}
+
+			owner[i] = n;
+			nodes[n].count++;
+		}
+
+		uint32_t first = 0;
+		for (auto& n : nodes)
+		{
+			n.first = first;
+			first += n.count;
+			n.count = 0;
+		}
+
+		std::vector<T> sorted(page->objects.size());
+		for (size_t i = 0; i < page->objects.size(); i++)
+		{
+			PageNode& n = nodes[owner[i]];
+			sorted[n.first + n.count++] = page->objects[i];
+		}
+
+		page->objects.swap(sorted);
+		page->built = true;
+
+		Account(page);
+		Trim(page);
+	}
+
+	inline bool Acquire(Page* page)
+	{
+		if (page->resident)
+		{
+			lru.splice(lru.begin(), lru, page->lru);
+			return true;
+		}
+
+		if (!Load(page))
+		{
+			failed = true;
+			return false;
+		}
+
+		page->resident = true;
+		lru.push_front(page);
+		page->lru = lru.begin();
+
+		Account(page);
+		Trim(page);
+		return true;
+	}
+
+	inline void Account(Page* page)
+	{
+		residentBytes -= page->bytes;
+		page->bytes = page->objects.capacity() * sizeof(T) + page->nodes.capacity() * sizeof(PageNode);
+		residentBytes += page->bytes;
+	}
+
+	// evicts cold pages until the budget is met, never evicting the page in use
+	inline void Trim(Page* inUse)
+	{
+		while (residentBytes > budget && !lru.empty() && lru.back() != inUse)
+		{
+			if (!Evict(lru.back()))
+				return;
+		}
+	}
+
+	inline bool Evict(Page* page)
+	{
+		if (page->dirty && !Store(page))
+		{
+			failed = true;
+			return false;
+		}
+
+		std::vector<T>().swap(page->objects);
+		std::vector<PageNode>().swap(page->nodes);
+		page->built = false;
+		page->resident = false;
+
+		Account(page);
+		lru.erase(page->lru);
+		return true;
+	}
+
+	inline bool Load(Page* page)
+	{
+		page->objects.clear();
+		page->nodes.clear();
+		page->built = false;
+		page->dirty = false;
+
+		if (0 == page->count)
+			return true;
+
+		std::FILE* file = std::fopen(ChunkPath(page->id).c_str(), "rb");
+		if (nullptr == file)
+			return false;
+
+		page->objects.resize(static_cast<size_t>(page->count));
+		size_t read = std::fread(page->objects.data(), sizeof(T), page->objects.size(), file);
+		std::fclose(file);
+
+		if (read != page->objects.size())
+		{
+			page->objects.clear();
+			return false;
+		}
+		return true;
+	}
+
+	// adds objects to the end of the chunk file; the first ones replace whatever file of that
+	// name a previous run left behind
+	inline bool Append(Page* page, const T* objects, size_t count)
+	{
+		std::FILE* file = std::fopen(ChunkPath(page->id).c_str(), 0 == page->count ? "wb" : "ab");
+		if (nullptr == file)
+			return false;
+		page->written = true;
+
+		size_t written = std::fwrite(objects, sizeof(T), count, file);
+		return (0 == std::fclose(file)) && written == count;
+	}
+
+	inline bool Store(Page* page)
+	{
+		std::FILE* file = std::fopen(ChunkPath(page->id).c_str(), "wb");
+		if (nullptr == file)
+			return false;
+		page->written = true;
+
+		size_t written = std::fwrite(page->objects.data(), sizeof(T), page->objects.size(), file);
+		bool ok = (0 == std::fclose(file)) && written == page->objects.size();
+
+		if (ok)
+			page->dirty = false;
+		return ok;
+	}
+
+private:
+	Node*				root;
+	std::string			directory;
+	size_t				budget;
+	size_t				residentBytes;
+	bool				failed;
+	std::vector<Page*>	pages;
+	std::list<Page*>	lru;
+};
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include "Vector3.h"
+#include "AABB.h"
+#include "Octree.h"
+
+template<typename P>
+struct OctreePoint
+{
+	vec3	position;
+	P		payload;
+};
+
+template<>
+struct OctreePoint<void>
+{
+	vec3	position;
+};
+
+template<typename P>
+struct PointOctreeNode
+{
+	typedef OctreePoint<P> Point;
+
+	PointOctreeNode**	children;
+	PointOctreeNode*	parent;
+	NodeBoundingBox		bound;
+	std::vector<Point>	points;
+
+	PointOctreeNode(const vec3& center, float halfSize)
+		:
+		children(nullptr),
+		parent(nullptr),
+		bound(NodeBoundingBox{ center, halfSize })
+	{
+
+	}
+
+	~PointOctreeNode()
+	{
+		if (nullptr != children)
+		{
+			for (size_t i = 0; i < 8; i++)
+				delete children[i];
+			delete[] children;
+			children = nullptr;
+		}
+	}
+
+	inline const NodeBoundingBox& GetBound() const { return bound; }
+
+	inline bool IsLeaf() const { return nullptr == children; }
+
+	// same child index encoding as OctreeNode::GetChildBound, bit set means the upper half
+	inline size_t GetChildIndex(const vec3& p) const
+	{
+		return
+			(bound.center.x <= p.x ? 1 : 0) |
+			(bound.center.y <= p.y ? 2 : 0) |
+			(bound.center.z <= p.z ? 4 : 0);
+	}
+
+	inline NodeBoundingBox GetChildBound(size_t idx) const
+	{
+		auto child = GetChild(idx);
+		if (nullptr != child)
+			return child->GetBound();
+
+		vec3 d{ (idx & 1) - 0.5f, ((idx >> 1) & 1) - 0.5f, ((idx >> 2 & 1)) - 0.5f };
+		vec3 c = bound.center + d * bound.halfSize;
+		return NodeBoundingBox{ c, bound.halfSize * 0.5f };
+	}
+
+	inline PointOctreeNode<P>* GetChild(size_t idx) const
+	{
+		if (IsLeaf())
+			return nullptr;
+		else
+			return children[idx];
+	}
+
+	inline void SetChild(size_t idx, PointOctreeNode<P>* node)
+	{
+		if (nullptr == children)
+			children = new PointOctreeNode*[8]{ nullptr };
+
+		children[idx] = node;
+	}
+};
+
+// Octree over raw points stored by value in the leaves, with an optional per-point payload P.
+// A leaf holds up to bucketSize points and splits once it overflows, so sparse regions stay
+// shallow; leaves at MAX_DEPTH take any number. Interior nodes hold no points and release
+// their storage when they split. Points are classified with AABB::Contains(const vec3&) at
+// the root and by comparison against the node centre below it, so no per-point AABB is needed.
+template<int MAX_DEPTH, typename P = void>
+class PointOctree
+{
+public:
+
+	typedef PointOctreeNode<P> Node;
+	typedef OctreePoint<P> Point;
+
+	inline PointOctree(vec3 center, float halfSize, size_t bucketSize = 16)
+		: root(new Node(center, halfSize)), count(0), bucketSize(bucketSize > 0 ? bucketSize : 1) { }
+
+	PointOctree(const PointOctree&) = delete;
+	PointOctree& operator = (const PointOctree&) = delete;
+
+	inline ~PointOctree() { delete root; }
+
+	// Insert(position) or Insert(position, payload); returns false if outside the root bound
+	template<typename... A>
+	inline bool Insert(const vec3& position, A&&... payload)
+	{
+		return Insert(Point{ position, std::forward<A>(payload)... });
+	}
+
+	inline bool Insert(const Point& point)
+	{
+		if (!AABB(root->GetBound()).Contains(point.position))
+			return false;
+
+		Node* node = root;
+		int depth = 0;
+		while (!node->IsLeaf())
+		{
+			node = GetOrCreateChild(node, node->GetChildIndex(point.position));
+			depth++;
+		}
+
+		node->points.push_back(point);
+		count++;
+
+		if (depth < MAX_DEPTH && node->points.size() > bucketSize)
+			Split(node, depth);
+		return true;
+	}
+
+	// calls func(const Point&) for every point inside box
+	template<typename F>
+	inline void Query(const AABB& box, F&& func) const { Query(root, box, func); }
+
+	// calls func(const Point&) for every point within radius of center
+	template<typename F>
+	inline void QueryRadius(const vec3& center, float radius, F&& func) const
+	{
+		vec3 r{ radius, radius, radius };
+		float radiusSq = radius * radius;
+
+		auto filter = [&](const Point& point)
+		{
+			vec3 d = point.position - center;
+			if (dot(d, d) <= radiusSq)
+				func(point);
+		};
+		Query(root, AABB(center - r, center + r), filter);
+	}
+
+	inline size_t GetCount() const { return count; }
+
+	inline size_t GetBucketSize() const { return bucketSize; }
+
+	inline const Node* GetRoot() const { return root; }
+
+private:
+
+	inline Node* GetOrCreateChild(Node* node, size_t idx)
+	{
+		Node* child = node->GetChild(idx);
+		if (nullptr == child)
+		{
+			NodeBoundingBox childBound = node->GetChildBound(idx);
+			child = new Node(childBound.center, childBound.halfSize);
+			child->parent = node;
+			node->SetChild(idx, child);
+		}
+		return child;
+	}
+
+	// moves the points of an overflowing leaf into its children, and on down while a child
+	// still overflows, e.g. for points packed closer than the child size
+	inline void Split(Node* leaf, int leafDepth)
+	{
+		std::vector<std::pair<Node*, int>> pending;
+		pending.push_back(std::make_pair(leaf, leafDepth));
+
+		while (!pending.empty())
+		{
+			Node* node = pending.back().first;
+			const int depth = pending.back().second;
+			pending.pop_back();
+
+			std::vector<Point> points;
+			points.swap(node->points);
+			for (const auto& point : points)
+				GetOrCreateChild(node, node->GetChildIndex(point.position))->points.push_back(point);
+
+			if (depth + 1 >= MAX_DEPTH)
+				continue;
+
+			for (size_t i = 0; i < 8; i++)
+			{
+				Node* child = node->GetChild(i);
+				if (nullptr != child && child->points.size() > bucketSize)
+					pending.push_back(std::make_pair(child, depth + 1));
+			}
+		}
+	}
+
+	template<typename F>
+	inline void Query(const Node* start, const AABB& box, F& func) const
+	{
+		const Node* stack[7 * MAX_DEPTH + 1];
+		int top = 0;
+		stack[top++] = start;
+
+		while (top > 0)
+		{
+			const Node* node = stack[--top];
+			if (!AABB(node->GetBound()).Intersects(box))
+				continue;
+
+			if (node->IsLeaf())
+			{
+				for (const auto& point : node->points)
+				{
+					if (box.Contains(point.position))
+						func(point);
+				}
+				continue;
+			}
+
+			for (size_t i = 0; i < 8; i++)
+			{
+				auto child = node->GetChild(i);
+				if (nullptr != child)
+					stack[top++] = child;
+			}
+		}
+	}
+
+private:
+	Node*		root;
+	size_t		count;
+	size_t		bucketSize;
+};
@@ -1,6 +1,7 @@
 #include "Renderer.h"
 #include "NativeWindow.h"
 
+#include <cstring>
 #include <fstream>
 #include <d3d11_1.h>
 #include <DirectXMath.h>
@@ -11,7 +12,7 @@
 namespace
 {
 	constexpr size_t initial_vertex_buffer_size = sizeof(float) * 6 * 8 * 512;
-	constexpr size_t initial_index_buffer_size = sizeof(Renderer::index_t) * 2 * 12 * 512;
+	constexpr size_t initial_index_buffer_size = sizeof(uint32_t) * 2 * 12 * 512;
 
 	struct Buffer
 	{
@@ -66,7 +67,7 @@ Renderer::Renderer(NativeWindow* win)
 	mIndexBufferSize(initial_index_buffer_size),
 	mNextVertexBufferSize(initial_vertex_buffer_size),
 	mNextIndexBufferSize(initial_index_buffer_size),
-	mStride(sizeof(float) * 6),
+	mStride(sizeof(DebugDrawList::Vertex)),
 	mConstantBufferProj(nullptr),
 	mConstantBufferView(nullptr),
 	mConstantBufferModel(nullptr),
@@ -189,40 +190,18 @@ Renderer::Renderer(NativeWindow* win)
 		mContext->RSSetViewports(1, &viewport);
 	}
 
+	for (size_t i = 0; i < buffer_count; i++)
 	{
-		D3D11_BUFFER_DESC vb_desc{ 0 };
-		vb_desc.Usage = D3D11_USAGE_DYNAMIC;
-		vb_desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-		vb_desc.ByteWidth = static_cast<UINT>(mVertexBufferSize);
-		vb_desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-
-		D3D11_BUFFER_DESC ib_desc{ 0 };
-		ib_desc.Usage = D3D11_USAGE_DYNAMIC;
-		ib_desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-		ib_desc.ByteWidth = static_cast<UINT>(mIndexBufferSize);
-		ib_desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-
-		for (size_t i = 0; i < buffer_count; i++)
-		{
-			if (S_OK != (hr = mDevice->CreateBuffer(&vb_desc, nullptr, &mVertexBuffers[i])))
-			{
-				mContext->Release();
-				mDevice->Release();
-				factory->Release();
-				return;
-			}
-
-			if (S_OK != (hr = mDevice->CreateBuffer(&ib_desc, nullptr, &mIndexBuffers[i])))
-			{
-				mContext->Release();
-				mDevice->Release();
-				factory->Release();
-				return;
-			}
+		mVertexBuffers[i] = nullptr;
+		mIndexBuffers[i] = nullptr;
+	}
 
-			mVertexBufferUsed[i] = 0;
-			mIndexBufferUsed[i] = 0;
-		}
+	if (!CreateBuffers())
+	{
+		mContext->Release();
+		mDevice->Release();
+		factory->Release();
+		return;
 	}
 
 	{
@@ -295,8 +274,6 @@ Renderer::Renderer(NativeWindow* win)
 		mContext->UpdateSubresource(mConstantBufferModel, 0, nullptr, &matModel, 0, 0);
 	}
 
-	MapBuffers(mCurrentBuffer);
-
 	mInited = true;
 }
 
@@ -304,11 +281,7 @@ Renderer::~Renderer()
 {
 	if (mInited)
 	{
-		for (size_t i = 0; i < buffer_count; i++)
-		{
-			mVertexBuffers[i]->Release();
-			mIndexBuffers[i]->Release();
-		}
+		ReleaseBuffers();
 
 		mRTV->Release();
 		mSwapChain->Release();
@@ -319,137 +292,12 @@ Renderer::~Renderer()
 
 void Renderer::AddLine(const vec3& start, const vec3& end, const vec3& col)
 {
-	float* p = reinterpret_cast<float*>(reinterpret_cast<char*>(mVertexBufferPointer) + mVertexBufferUsed[mCurrentBuffer]);
-
-	index_t idx = static_cast<index_t>(mVertexBufferUsed[mCurrentBuffer] / mStride);
-
-	*(p++) = start.x;
-	*(p++) = start.y;
-	*(p++) = start.z;
-	*(p++) = col.x;
-	*(p++) = col.y;
-	*(p++) = col.z;
-
-	*(p++) = end.x;
-	*(p++) = end.y;
-	*(p++) = end.z;
-	*(p++) = col.x;
-	*(p++) = col.y;
-	*(p++) = col.z;
-
-	mVertexBufferUsed[mCurrentBuffer] += mStride * 2;
-
-	index_t* q = reinterpret_cast<index_t*>(reinterpret_cast<char*>(mIndexBufferPointer) + mIndexBufferUsed[mCurrentBuffer]);
-
-	*(q++) = idx;
-	*(q++) = idx + 1;
-
-	mIndexBufferUsed[mCurrentBuffer] += sizeof(index_t) * 2;
+	mBatch.AddLine(start, end, col);
 }
 
 void Renderer::AddBox(const AABB& box, const vec3& col)
 {
-	float* p = reinterpret_cast<float*>(reinterpret_cast<char*>(mVertexBufferPointer) + mVertexBufferUsed[mCurrentBuffer]);
-
-	index_t idx = static_cast<index_t>(mVertexBufferUsed[mCurrentBuffer] / mStride);
-
-	*(p++) = box.min.x;
-	*(p++) = box.min.y;
-	*(p++) = box.min.z;
-	*(p++) = col.x;
-	*(p++) = col.y;
-	*(p++) = col.z;
-
-	*(p++) = box.max.x;
-	*(p++) = box.min.y;
-	*(p++) = box.min.z;
-	*(p++) = col.x;
-	*(p++) = col.y;
-	*(p++) = col.z;
-
-	*(p++) = box.min.x;
-	*(p++) = box.min.y;
-	*(p++) = box.max.z;
-	*(p++) = col.x;
-	*(p++) = col.y;
-	*(p++) = col.z;
-
-	*(p++) = box.max.x;
-	*(p++) = box.min.y;
-	*(p++) = box.max.z;
-	*(p++) = col.x;
-	*(p++) = col.y;
-	*(p++) = col.z;
-
-	*(p++) = box.min.x;
-	*(p++) = box.max.y;
-	*(p++) = box.min.z;
-	*(p++) = col.x;
-	*(p++) = col.y;
-	*(p++) = col.z;
-
-	*(p++) = box.max.x;
-	*(p++) = box.max.y;
-	*(p++) = box.min.z;
-	*(p++) = col.x;
-	*(p++) = col.y;
-	*(p++) = col.z;
-
-	*(p++) = box.min.x;
-	*(p++) = box.max.y;
-	*(p++) = box.max.z;
-	*(p++) = col.x;
-	*(p++) = col.y;
-	*(p++) = col.z;
-
-	*(p++) = box.max.x;
-	*(p++) = box.max.y;
-	*(p++) = box.max.z;
-	*(p++) = col.x;
-	*(p++) = col.y;
-	*(p++) = col.z;
-
-	mVertexBufferUsed[mCurrentBuffer] += mStride * 8;
-
-	index_t* q = reinterpret_cast<index_t*>(reinterpret_cast<char*>(mIndexBufferPointer) + mIndexBufferUsed[mCurrentBuffer]);
-
-	*(q++) = idx;
-	*(q++) = idx + 1;
-
-	*(q++) = idx;
-	*(q++) = idx + 2;
-
-	*(q++) = idx + 1;
-	*(q++) = idx + 3;
-
-	*(q++) = idx + 2;
-	*(q++) = idx + 3;
-
-	*(q++) = idx;
-	*(q++) = idx + 4;
-
-	*(q++) = idx + 1;
-	*(q++) = idx + 5;
-
-	*(q++) = idx + 2;
-	*(q++) = idx + 6;
-
-	*(q++) = idx + 3;
-	*(q++) = idx + 7;
-
-	*(q++) = idx + 4;
-	*(q++) = idx + 5;
-
-	*(q++) = idx + 4;
-	*(q++) = idx + 6;
-
-	*(q++) = idx + 5;
-	*(q++) = idx + 7;
-
-	*(q++) = idx + 6;
-	*(q++) = idx + 7;
-
-	mIndexBufferUsed[mCurrentBuffer] += sizeof(index_t) * 2 * 12;
+	mBatch.AddBox(box, col);
 }
 
 void Renderer::Clear()
@@ -461,13 +309,10 @@ void Renderer::Clear()
 
 void Renderer::Render()
 {
-	UnmapBuffers(mCurrentBuffer);
-	size_t drawIdx = (mCurrentBuffer == 0) ? (buffer_count - 1) : (mCurrentBuffer - 1);
-
+	size_t drawIdx = mCurrentBuffer;
 	mCurrentBuffer = (mCurrentBuffer + 1) % buffer_count;
-	MapBuffers(mCurrentBuffer);
 
-	if (mIndexBufferUsed[drawIdx] > 0)
+	if (mBatch.GetIndexCount() > 0 && Upload(drawIdx))
 	{
 		UINT offset = 0;
 
@@ -486,13 +331,15 @@ void Renderer::Render()
 		mContext->VSSetConstantBuffers(2, 1, &mConstantBufferModel);
 
 		mContext->IASetVertexBuffers(0, 1, &mVertexBuffers[drawIdx], &mStride, &offset);
-		mContext->IASetIndexBuffer(mIndexBuffers[drawIdx], DXGI_FORMAT_R16_UINT, 0);
+		mContext->IASetIndexBuffer(mIndexBuffers[drawIdx], mBatch.Uses32BitIndices() ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT, 0);
 
 		mContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_LINELIST);
 
-		mContext->DrawIndexed(static_cast<UINT>(mIndexBufferUsed[drawIdx] / sizeof(index_t)), 0, 0);
+		mContext->DrawIndexed(static_cast<UINT>(mBatch.GetIndexCount()), 0, 0);
 	}
 
+	mBatch.Clear();
+
 }
 
 void Renderer::Present()
@@ -506,23 +353,97 @@ void Renderer::SetCameraLookTo(const vec3& eye, const vec3& dir)
 	mLookDirection = dir;
 }
 
-void Renderer::MapBuffers(size_t idx)
+// builds the ring at the next sizes aside, so a failed regrow leaves the old one in place
+bool Renderer::CreateBuffers()
 {
-	D3D11_MAPPED_SUBRESOURCE mapped_resource;
+	D3D11_BUFFER_DESC vb_desc{ 0 };
+	vb_desc.Usage = D3D11_USAGE_DYNAMIC;
+	vb_desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	vb_desc.ByteWidth = static_cast<UINT>(mNextVertexBufferSize);
+	vb_desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+	D3D11_BUFFER_DESC ib_desc{ 0 };
+	ib_desc.Usage = D3D11_USAGE_DYNAMIC;
+	ib_desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	ib_desc.ByteWidth = static_cast<UINT>(mNextIndexBufferSize);
+	ib_desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+	ID3D11Buffer* vertexBuffers[buffer_count] = { nullptr };
+	ID3D11Buffer* indexBuffers[buffer_count] = { nullptr };
+
+	for (size_t i = 0; i < buffer_count; i++)
+	{
+		if (S_OK != mDevice->CreateBuffer(&vb_desc, nullptr, &vertexBuffers[i]) ||
+			S_OK != mDevice->CreateBuffer(&ib_desc, nullptr, &indexBuffers[i]))
+		{
+			for (size_t j = 0; j <= i; j++)
+			{
+				if (nullptr != vertexBuffers[j])
+					vertexBuffers[j]->Release();
+				if (nullptr != indexBuffers[j])
+					indexBuffers[j]->Release();
+			}
+			return false;
+		}
+	}
 
-	mContext->Map(mVertexBuffers[idx], 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource);
-	mVertexBufferPointer = reinterpret_cast<float*>(mapped_resource.pData);
+	ReleaseBuffers();
+	for (size_t i = 0; i < buffer_count; i++)
+	{
+		mVertexBuffers[i] = vertexBuffers[i];
+		mIndexBuffers[i] = indexBuffers[i];
+	}
 
-	mContext->Map(mIndexBuffers[idx], 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource);
-	mIndexBufferPointer = reinterpret_cast<index_t*>(mapped_resource.pData);
+	mVertexBufferSize = mNextVertexBufferSize;
+	mIndexBufferSize = mNextIndexBufferSize;
+	return true;
+}
 
-	mVertexBufferUsed[idx] = 0;
-	mIndexBufferUsed[idx] = 0;
+void Renderer::ReleaseBuffers()
+{
+	for (size_t i = 0; i < buffer_count; i++)
+	{
+		if (nullptr != mVertexBuffers[i])
+			mVertexBuffers[i]->Release();
+		if (nullptr != mIndexBuffers[i])
+			mIndexBuffers[i]->Release();
+
+		mVertexBuffers[i] = nullptr;
+		mIndexBuffers[i] = nullptr;
+	}
 }
 
-void Renderer::UnmapBuffers(size_t idx)
+bool Renderer::Upload(size_t idx)
 {
+	const size_t vertexBytes = mBatch.GetVertexCount() * sizeof(DebugDrawList::Vertex);
+	const size_t indexBytes = mBatch.GetIndexCount() * mBatch.GetIndexSize();
+
+	// the whole ring is regrown together, doubling so it settles after a few frames
+	if (vertexBytes > mVertexBufferSize || indexBytes > mIndexBufferSize)
+	{
+		while (mNextVertexBufferSize < vertexBytes)
+			mNextVertexBufferSize *= 2;
+		while (mNextIndexBufferSize < indexBytes)
+			mNextIndexBufferSize *= 2;
+
+		if (!CreateBuffers())
+			return false;
+	}
+
+	if (nullptr == mVertexBuffers[idx] || nullptr == mIndexBuffers[idx])
+		return false;
+
+	D3D11_MAPPED_SUBRESOURCE mapped_resource;
+
+	if (S_OK != mContext->Map(mVertexBuffers[idx], 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource))
+		return false;
+	std::memcpy(mapped_resource.pData, mBatch.GetVertices().data(), vertexBytes);
 	mContext->Unmap(mVertexBuffers[idx], 0);
+
+	if (S_OK != mContext->Map(mIndexBuffers[idx], 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource))
+		return false;
+	std::memcpy(mapped_resource.pData, mBatch.GetIndexData(), indexBytes);
 	mContext->Unmap(mIndexBuffers[idx], 0);
-}
 
+	return true;
+}
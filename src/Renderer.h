@@ -2,6 +2,7 @@
 
 #include "Vector3.h"
 #include "AABB.h"
+#include "DebugDraw.h"
 
 class NativeWindow;
 
@@ -20,9 +21,6 @@ constexpr size_t buffer_count = 3;
 
 class Renderer
 {
-public:
-	typedef unsigned short index_t;
-
 private:
 	bool						mInited;
 	ID3D11Device1*				mDevice;
@@ -48,11 +46,7 @@ private:
 	size_t						mNextVertexBufferSize;
 	size_t						mNextIndexBufferSize;
 
-	float*						mVertexBufferPointer;
-	index_t*					mIndexBufferPointer;
-
-	size_t						mVertexBufferUsed[buffer_count];
-	size_t						mIndexBufferUsed[buffer_count];
+	DebugDrawList				mBatch;
 
 	unsigned int				mStride;
 
@@ -79,12 +73,16 @@ public:
 
 	void SetCameraLookTo(const vec3& eye, const vec3& dir);
 
+	// lines and boxes added since the last Render()
+	inline const DebugDrawList& GetBatch() const { return mBatch; }
+
 public:
 	inline operator bool() const { return mInited; }
 
 private:
-	void MapBuffers(size_t idx);
-	void UnmapBuffers(size_t idx);
+	bool CreateBuffers();
+	void ReleaseBuffers();
+	bool Upload(size_t idx);
 };
 
 
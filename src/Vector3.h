@@ -1,5 +1,15 @@
 #pragma once
 
+// SSE2 or AArch64 NEON for the float vector and box operations, OCTREE_NO_SIMD keeps
+// the scalar code everywhere. Not on 32 bit MSVC, which cannot pass the aligned vector by value.
+#if !defined(OCTREE_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#define OCTREE_SIMD_SSE 1
+#include <emmintrin.h>
+#elif !defined(OCTREE_NO_SIMD) && defined(__aarch64__)
+#define OCTREE_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
 template<typename T>
 struct Vector3
 {
@@ -9,6 +19,87 @@ struct Vector3
 	inline operator Vector3<N>() const { return Vector3<N>{static_cast<N>(x), static_cast<N>(y), static_cast<N>(z)}; }
 };
 
+#if defined(OCTREE_SIMD_SSE) || defined(OCTREE_SIMD_NEON)
+// Padded to four lanes and aligned so a vector loads and stores with one instruction.
+// w only fills the register, the operations keep it 0 and comparisons ignore it.
+template<>
+struct alignas(16) Vector3<float>
+{
+	float x, y, z;
+	float w = 0.0f;
+
+	template<typename N>
+	inline operator Vector3<N>() const { return Vector3<N>{static_cast<N>(x), static_cast<N>(y), static_cast<N>(z)}; }
+};
+
+namespace OctreeSimd
+{
+#ifdef OCTREE_SIMD_SSE
+	typedef __m128 Register;
+
+	inline Register Load(const Vector3<float>& v) { return _mm_load_ps(&v.x); }
+	inline Vector3<float> Store(Register r) { Vector3<float> v; _mm_store_ps(&v.x, r); return v; }
+	inline Register Splat(float f) { return _mm_set_ps(0.0f, f, f, f); }
+
+	inline Register Add(Register a, Register b) { return _mm_add_ps(a, b); }
+	inline Register Sub(Register a, Register b) { return _mm_sub_ps(a, b); }
+	inline Register Mul(Register a, Register b) { return _mm_mul_ps(a, b); }
+	inline Register Min(Register a, Register b) { return _mm_min_ps(a, b); }
+	inline Register Max(Register a, Register b) { return _mm_max_ps(a, b); }
+
+	// a <= b and c <= d in each of x, y and z
+	inline bool AllLessEqual(Register a, Register b, Register c, Register d)
+	{
+		return 7 == (_mm_movemask_ps(_mm_and_ps(_mm_cmple_ps(a, b), _mm_cmple_ps(c, d))) & 7);
+	}
+#else
+	typedef float32x4_t Register;
+
+	inline Register Load(const Vector3<float>& v) { return vld1q_f32(&v.x); }
+	inline Vector3<float> Store(Register r) { Vector3<float> v; vst1q_f32(&v.x, r); return v; }
+	inline Register Splat(float f) { return vsetq_lane_f32(0.0f, vdupq_n_f32(f), 3); }
+
+	inline Register Add(Register a, Register b) { return vaddq_f32(a, b); }
+	inline Register Sub(Register a, Register b) { return vsubq_f32(a, b); }
+	inline Register Mul(Register a, Register b) { return vmulq_f32(a, b); }
+	inline Register Min(Register a, Register b) { return vminq_f32(a, b); }
+	inline Register Max(Register a, Register b) { return vmaxq_f32(a, b); }
+
+	// a <= b and c <= d in each of x, y and z
+	inline bool AllLessEqual(Register a, Register b, Register c, Register d)
+	{
+		uint32x4_t m = vandq_u32(vcleq_f32(a, b), vcleq_f32(c, d));
+		return 0 != vminvq_u32(vsetq_lane_u32(0xffffffffu, m, 3));
+	}
+#endif
+}
+
+inline Vector3<float> operator + (const Vector3<float>& a, const Vector3<float>& b)
+{
+	return OctreeSimd::Store(OctreeSimd::Add(OctreeSimd::Load(a), OctreeSimd::Load(b)));
+}
+
+inline Vector3<float> operator - (const Vector3<float>& a, const Vector3<float>& b)
+{
+	return OctreeSimd::Store(OctreeSimd::Sub(OctreeSimd::Load(a), OctreeSimd::Load(b)));
+}
+
+inline Vector3<float> operator * (const Vector3<float>& a, const Vector3<float>& b)
+{
+	return OctreeSimd::Store(OctreeSimd::Mul(OctreeSimd::Load(a), OctreeSimd::Load(b)));
+}
+
+inline Vector3<float> operator * (const Vector3<float>& a, float b)
+{
+	return OctreeSimd::Store(OctreeSimd::Mul(OctreeSimd::Load(a), OctreeSimd::Splat(b)));
+}
+
+inline Vector3<float> operator * (float a, const Vector3<float>& b)
+{
+	return OctreeSimd::Store(OctreeSimd::Mul(OctreeSimd::Splat(a), OctreeSimd::Load(b)));
+}
+#endif
+
 template<typename T>
 inline Vector3<T> operator + (const Vector3<T>& a, const Vector3<T>& b)
 {
@@ -58,4 +149,5 @@ inline Vector3<T> cross(const Vector3<T>& a, const Vector3<T>& b)
 }
 
 typedef Vector3<float>	vec3;
+typedef Vector3<double>	dvec3;
 typedef Vector3<int>	ivec3;
@@ -0,0 +1,445 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#include "Vector3.h"
+
+enum class VoxelState : unsigned char
+{
+	Empty,
+	Full,
+	Mixed,
+};
+
+// 8x8x8 occupancy bitmask, one 64-bit word per z slice
+struct VoxelBrick
+{
+	static constexpr int size = 8;
+	static constexpr uint64_t capacity = size * size * size;
+
+	uint64_t	bits[size];
+
+	inline bool Get(int x, int y, int z) const { return 0 != ((bits[z] >> (y * size + x)) & 1); }
+
+	inline void Set(int x, int y, int z, bool value)
+	{
+		uint64_t mask = uint64_t(1) << (y * size + x);
+		if (value)
+			bits[z] |= mask;
+		else
+			bits[z] &= ~mask;
+	}
+
+	inline void Fill(bool value) { std::memset(bits, value ? 0xff : 0x00, sizeof(bits)); }
+};
+
+struct VoxelNode
+{
+	VoxelNode**		children;
+	VoxelNode*		parent;
+	VoxelBrick*		brick;
+	uint64_t		count;
+	VoxelState		state;
+
+	VoxelNode(VoxelNode* parent, VoxelState state, uint64_t count)
+		:
+		children(nullptr),
+		parent(parent),
+		brick(nullptr),
+		count(count),
+		state(state)
+	{
+
+	}
+
+	~VoxelNode() { Collapse(state); }
+
+	inline bool IsUniform() const { return VoxelState::Mixed != state; }
+
+	inline VoxelNode* GetChild(size_t idx) const { return nullptr == children ? nullptr : children[idx]; }
+
+	// drops children or brick and marks the node uniform
+	inline void Collapse(VoxelState uniform)
+	{
+		if (nullptr != children)
+		{
+			for (size_t i = 0; i < 8; i++)
+				delete children[i];
+			delete[] children;
+			children = nullptr;
+		}
+
+		if (nullptr != brick)
+		{
+			delete brick;
+			brick = nullptr;
+		}
+
+		state = uniform;
+	}
+};
+
+// Sparse voxel occupancy grid of (8 << MAX_DEPTH)^3 voxels. Leaves at MAX_DEPTH are 8^3
+// bricks, every node carries its state and occupied voxel count, and uniform subtrees are
+// collapsed into a single Empty or Full node so queries and ray marching can stop early.
+template<int MAX_DEPTH>
+class VoxelOctree
+{
+public:
+
+	typedef VoxelNode Node;
+
+	static constexpr int resolution = VoxelBrick::size << MAX_DEPTH;
+
+	inline VoxelOctree(vec3 origin, float voxelSize)
+		: root(new Node(nullptr, VoxelState::Empty, 0)), origin(origin), voxelSize(voxelSize) { }
+
+	VoxelOctree(const VoxelOctree&) = delete;
+	VoxelOctree& operator = (const VoxelOctree&) = delete;
+
+	inline ~VoxelOctree() { delete root; }
+
+	static inline bool InRange(const ivec3& v)
+	{
+		return
+			0 <= v.x && v.x < resolution &&
+			0 <= v.y && v.y < resolution &&
+			0 <= v.z && v.z < resolution;
+	}
+
+	// voxel containing a world space position, not range checked
+	inline ivec3 ToVoxel(const vec3& p) const
+	{
+		vec3 v = (p - origin) / voxelSize;
+		return ivec3{ static_cast<int>(std::floor(v.x)), static_cast<int>(std::floor(v.y)), static_cast<int>(std::floor(v.z)) };
+	}
+
+	inline bool Get(const ivec3& v) const
+	{
+		if (!InRange(v))
+			return false;
+
+		const Node* node = root;
+		for (int depth = 0; depth < MAX_DEPTH; depth++)
+		{
+			if (node->IsUniform())
+				return VoxelState::Full == node->state;
+
+			node = node->GetChild(ChildIndex(v, depth));
+			if (nullptr == node)
+				return false;
+		}
+
+		if (node->IsUniform())
+			return VoxelState::Full == node->state;
+
+		return node->brick->Get(v.x & 7, v.y & 7, v.z & 7);
+	}
+
+	inline void Set(const ivec3& v, bool value)
+	{
+		if (!InRange(v))
+			return;
+
+		const VoxelState target = value ? VoxelState::Full : VoxelState::Empty;
+
+		Node* node = root;
+		for (int depth = 0; depth < MAX_DEPTH; depth++)
+		{
+			if (target == node->state)
+				return;
+
+			if (node->IsUniform())
+				Split(node, depth);
+
+			size_t idx = ChildIndex(v, depth);
+			Node* child = node->children[idx];
+			if (nullptr == child)
+			{
+				if (!value)
+					return;
+				child = node->children[idx] = new Node(node, VoxelState::Empty, 0);
+			}
+			node = child;
+		}
+
+		if (target == node->state)
+			return;
+
+		if (node->IsUniform())
+			Split(node, MAX_DEPTH);
+
+		int x = v.x & 7, y = v.y & 7, z = v.z & 7;
+		if (node->brick->Get(x, y, z) == value)
+			return;
+		node->brick->Set(x, y, z, value);
+
+		for (int depth = MAX_DEPTH; nullptr != node; depth--, node = node->parent)
+		{
+			if (value)
+				node->count++;
+			else
+				node->count--;
+
+			if (0 == node->count)
+				node->Collapse(VoxelState::Empty);
+			else if (Capacity(depth) == node->count)
+				node->Collapse(VoxelState::Full);
+			else
+				node->state = VoxelState::Mixed;
+		}
+	}
+
+	// number of occupied voxels in the inclusive voxel range [lo, hi]
+	inline uint64_t Count(const ivec3& lo, const ivec3& hi) const
+	{
+		return Count(root, ivec3{ 0, 0, 0 }, resolution, lo, hi, false);
+	}
+
+	inline bool IsEmpty(const ivec3& lo, const ivec3& hi) const
+	{
+		return 0 == Count(root, ivec3{ 0, 0, 0 }, resolution, lo, hi, true);
+	}
+
+	inline uint64_t GetCount() const { return root->count; }
+
+	// marches a world space ray, returning the first occupied voxel and the distance along dir
+	inline bool Raycast(const vec3& from, const vec3& dir, float maxT, ivec3& hit, float& t) const
+	{
+		Ray ray;
+		ray.origin = (from - origin) / voxelSize;
+		ray.dir = dir / voxelSize;
+		ray.inv = vec3{ 1.0f / ray.dir.x, 1.0f / ray.dir.y, 1.0f / ray.dir.z };
+		ray.maxT = maxT;
+
+		return Raycast(root, ivec3{ 0, 0, 0 }, resolution, ray, hit, t);
+	}
+
+	inline const Node* GetRoot() const { return root; }
+
+private:
+
+	struct Ray
+	{
+		vec3	origin;
+		vec3	dir;
+		vec3	inv;
+		float	maxT;
+	};
+
+	static inline uint64_t Capacity(int depth) { return VoxelBrick::capacity << (3 * (MAX_DEPTH - depth)); }
+
+	// same child index encoding as OctreeNode::GetChildBound
+	static inline size_t ChildIndex(const ivec3& v, int depth)
+	{
+		int shift = MAX_DEPTH - depth + 2;
+		return ((v.x >> shift) & 1) | (((v.y >> shift) & 1) << 1) | (((v.z >> shift) & 1) << 2);
+	}
+
+	static inline void Split(Node* node, int depth)
+	{
+		const bool full = VoxelState::Full == node->state;
+
+		if (MAX_DEPTH == depth)
+		{
+			node->brick = new VoxelBrick;
+			node->brick->Fill(full);
+		}
+		else
+		{
+			node->children = new Node*[8]{ nullptr };
+			if (full)
+			{
+				for (size_t i = 0; i < 8; i++)
+					node->children[i] = new Node(node, VoxelState::Full, Capacity(depth + 1));
+			}
+		}
+
+		node->state = VoxelState::Mixed;
+	}
+
+	static inline uint64_t Count(const Node* node, const ivec3& lo, int size, const ivec3& qlo, const ivec3& qhi, bool any)
+	{
+		ivec3 a{ lo.x > qlo.x ? lo.x : qlo.x, lo.y > qlo.y ? lo.y : qlo.y, lo.z > qlo.z ? lo.z : qlo.z };
+		ivec3 b{ lo.x + size - 1 < qhi.x ? lo.x + size - 1 : qhi.x, lo.y + size - 1 < qhi.y ? lo.y + size - 1 : qhi.y, lo.z + size - 1 < qhi.z ? lo.z + size - 1 : qhi.z };
+
+		if (nullptr == node || VoxelState::Empty == node->state || a.x > b.x || a.y > b.y || a.z > b.z)
+			return 0;
+
+		uint64_t overlap = uint64_t(b.x - a.x + 1) * uint64_t(b.y - a.y + 1) * uint64_t(b.z - a.z + 1);
+
+		if (VoxelState::Full == node->state)
+			return overlap;
+
+		if (overlap == uint64_t(size) * uint64_t(size) * uint64_t(size))
+			return node->count;
+
+		if (nullptr != node->brick)
+		{
+			uint64_t n = 0;
+			for (int z = a.z; z <= b.z; z++)
+				for (int y = a.y; y <= b.y; y++)
+					for (int x = a.x; x <= b.x; x++)
+						n += node->brick->Get(x - lo.x, y - lo.y, z - lo.z) ? 1 : 0;
+			return n;
+		}
+
+		int half = size >> 1;
+		uint64_t n = 0;
+		for (size_t i = 0; i < 8 && !(any && n > 0); i++)
+		{
+			ivec3 clo{ lo.x + ((i & 1) ? half : 0), lo.y + (((i >> 1) & 1) ? half : 0), lo.z + (((i >> 2) & 1) ? half : 0) };
+			n += Count(node->GetChild(i), clo, half, qlo, qhi, any);
+		}
+		return n;
+	}
+
+	static inline bool Slab(const Ray& ray, const ivec3& lo, int size, float& tEnter, float& tExit)
+	{
+		float t0 = 0.0f, t1 = ray.maxT;
+		const float o[3] = { ray.origin.x, ray.origin.y, ray.origin.z };
+		const float inv[3] = { ray.inv.x, ray.inv.y, ray.inv.z };
+		const int l[3] = { lo.x, lo.y, lo.z };
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float ta = (l[axis] - o[axis]) * inv[axis];
+			float tb = (l[axis] + size - o[axis]) * inv[axis];
+			if (ta > tb)
+			{
+				float tmp = ta; ta = tb; tb = tmp;
+			}
+			// a ray parallel to the slab yields nan for a zero numerator, treat as unbounded
+			if (ta > t0)
+				t0 = ta;
+			if (tb < t1)
+				t1 = tb;
+		}
+
+		tEnter = t0;
+		tExit = t1;
+		return t0 <= t1;
+	}
+
+	static inline bool Raycast(const Node* node, const ivec3& lo, int size, const Ray& ray, ivec3& hit, float& t)
+	{
+		float tEnter, tExit;
+		if (nullptr == node || VoxelState::Empty == node->state || !Slab(ray, lo, size, tEnter, tExit))
+			return false;
+
+		if (VoxelState::Full == node->state)
+		{
+			vec3 p = ray.origin + ray.dir * tEnter;
+			hit = ivec3{ Clamp(p.x, lo.x, size), Clamp(p.y, lo.y, size), Clamp(p.z, lo.z, size) };
+			t = tEnter;
+			return true;
+		}
+
+		if (nullptr != node->brick)
+			return March(*node->brick, lo, ray, tEnter, tExit, hit, t);
+
+		// visit children front to back
+		int half = size >> 1;
+		size_t order[8];
+		float entry[8];
+		size_t n = 0;
+		for (size_t i = 0; i < 8; i++)
+		{
+			const Node* child = node->GetChild(i);
+			if (nullptr == child || VoxelState::Empty == child->state)
+				continue;
+
+			ivec3 clo{ lo.x + ((i & 1) ? half : 0), lo.y + (((i >> 1) & 1) ? half : 0), lo.z + (((i >> 2) & 1) ? half : 0) };
+			float c0, c1;
+			if (!Slab(ray, clo, half, c0, c1))
+				continue;
+
+			size_t j = n++;
+			for (; j > 0 && entry[j - 1] > c0; j--)
+			{
+				entry[j] = entry[j - 1];
+				order[j] = order[j - 1];
+			}
+			entry[j] = c0;
+			order[j] = i;
+		}
+
+		for (size_t k = 0; k < n; k++)
+		{
+			size_t i = order[k];
+			ivec3 clo{ lo.x + ((i & 1) ? half : 0), lo.y + (((i >> 1) & 1) ? half : 0), lo.z + (((i >> 2) & 1) ? half : 0) };
+			if (Raycast(node->GetChild(i), clo, half, ray, hit, t))
+				return true;
+		}
+		return false;
+	}
+
+	static inline int Clamp(float p, int lo, int size)
+	{
+		int v = static_cast<int>(std::floor(p));
+		return v < lo ? lo : (v >= lo + size ? lo + size - 1 : v);
+	}
+
+	// 3D DDA through a single brick
+	static inline bool March(const VoxelBrick& brick, const ivec3& lo, const Ray& ray, float tEnter, float tExit, ivec3& hit, float& t)
+	{
+		const float o[3] = { ray.origin.x, ray.origin.y, ray.origin.z };
+		const float d[3] = { ray.dir.x, ray.dir.y, ray.dir.z };
+		const int l[3] = { lo.x, lo.y, lo.z };
+		const float inf = std::numeric_limits<float>::infinity();
+
+		int cell[3], step[3];
+		float tMax[3], tDelta[3];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			cell[axis] = Clamp(o[axis] + d[axis] * tEnter, l[axis], VoxelBrick::size) - l[axis];
+			if (d[axis] > 0.0f)
+			{
+				step[axis] = 1;
+				tMax[axis] = (l[axis] + cell[axis] + 1 - o[axis]) / d[axis];
+				tDelta[axis] = 1.0f / d[axis];
+			}
+			else if (d[axis] < 0.0f)
+			{
+				step[axis] = -1;
+				tMax[axis] = (l[axis] + cell[axis] - o[axis]) / d[axis];
+				tDelta[axis] = -1.0f / d[axis];
+			}
+			else
+			{
+				step[axis] = 0;
+				tMax[axis] = inf;
+				tDelta[axis] = inf;
+			}
+		}
+
+		float tCur = tEnter;
+		while (tCur <= tExit)
+		{
+			if (brick.Get(cell[0], cell[1], cell[2]))
+			{
+				hit = ivec3{ l[0] + cell[0], l[1] + cell[1], l[2] + cell[2] };
+				t = tCur;
+				return true;
+			}
+
+			int axis = tMax[0] < tMax[1] ? (tMax[0] < tMax[2] ? 0 : 2) : (tMax[1] < tMax[2] ? 1 : 2);
+			cell[axis] += step[axis];
+			if (cell[axis] < 0 || cell[axis] >= VoxelBrick::size)
+				return false;
+
+			tCur = tMax[axis];
+			tMax[axis] += tDelta[axis];
+		}
+		return false;
+	}
+
+private:
+	Node*	root;
+	vec3	origin;
+	float	voxelSize;
+};
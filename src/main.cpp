@@ -30,28 +30,17 @@ namespace
 		}
 	}
 
-	void render_octree(Renderer& renderer, const OctreeNode<Obj>* node)
+	void render_octree(Renderer& renderer, const Octree<Obj, 3>& octree)
 	{
-		if (nullptr == node)
-			return;
-
-		if (node->IsLeaf())
+		for (auto node : octree.Nodes())
 		{
 			render_objects(renderer, node->objects);
-		}
-		else
-		{
-			if (nullptr != node->objects)
-			{
-				render_objects(renderer, node->objects);
-			}
 
-			for (size_t i = 0; i < 8; i++)
+			if (!node->IsLeaf())
 			{
-				renderer.AddBox(node->GetChildBound(i), vec3{ 0.0f, 1.0f, 0.0f });
-				render_octree(renderer, node->GetChild(i));
+				for (size_t i = 0; i < 8; i++)
+					renderer.AddBox(node->GetChildBound(i), vec3{ 0.0f, 1.0f, 0.0f });
 			}
-
 		}
 	}
 }
@@ -82,7 +71,7 @@ int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
 	{
 		renderer.Clear();
 
-		render_octree(renderer, octree.GetRoot());
+		render_octree(renderer, octree);
 
 		renderer.Render();
 